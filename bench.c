@@ -0,0 +1,164 @@
+/*
+ * times the vectorized kernels against their scalar fallbacks on a
+ * synthetic list: the field scanner of the parser and the search of a
+ * query in the keys. Usage: bench [stations]
+ */
+#define main cradio_main
+#include "cradio.c"
+#undef main
+
+#define BENCH_RUNS 5
+
+struct kernel {
+	const char *name;
+	const char *(*scan)(const char *, const char *);
+	const char *(*find)(const char *, size_t, const char *);
+	const char *(*find_long)(const char *, size_t, const char *);
+};
+
+static const char *queries[] = {
+	"soma", "jazz - s", "groove salad", "xyzzy", "n 49999",
+};
+
+/* a list of n stations like the example, in a temporary file */
+FILE *
+bench_list(size_t n)
+{
+	static const char *genre[] = {
+		"Groove Salad", "Jazz - Smooth", "Drone Zone", "Indie Pop",
+		"Deep Space One", "Secret Agent", "Lush", "Sonic Universe",
+	};
+	FILE *f = tmpfile();
+	size_t i;
+
+	for (i = 0; f && i < n; i++) {
+		fprintf(f, "\"SomaFM %s %zu\" "
+		    "\"http://ice%zu.somafm.com/stream/%zu-128-mp3\"\n",
+		    genre[i % 8], i, i % 7, i);
+	}
+	if (f && fflush(f) != 0) {
+		fclose(f);
+		f = NULL;
+	}
+	return f;
+}
+
+/* best of BENCH_RUNS parses of stream, in ms */
+double
+bench_parse(FILE *stream)
+{
+	struct station_list sl;
+	struct timespec t0;
+	double ms, best = -1;
+	int r;
+
+	for (r = 0; r < BENCH_RUNS; r++) {
+		rewind(stream);
+		if (station_list_init(&sl, "bench") < 0
+		    || map_stations(&sl, stream) < 0) {
+			return -1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (parse_stations(&sl) < 0) {
+			return -1;
+		}
+		ms = elapsed_ms(&t0);
+		best = best < 0 ? ms : MIN(best, ms);
+		station_list_free(&sl);
+	}
+	return best;
+}
+
+/* best of BENCH_RUNS searches of q in every key, in ms */
+double
+bench_find(const struct station_list *sl, const char *q, size_t *hits)
+{
+	const struct station *s;
+	struct timespec t0;
+	double ms, best = -1;
+	size_t i;
+	int r;
+
+	for (r = 0; r < BENCH_RUNS; r++) {
+		*hits = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (i = 0; i < sl->nrec; i++) {
+			s = &sl->stations[i];
+			*hits += key_find(field_ptr(sl, s->key), s->key.len,
+			    q) != NULL;
+		}
+		ms = elapsed_ms(&t0);
+		best = best < 0 ? ms : MIN(best, ms);
+	}
+	return best;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct kernel k[3];
+	struct station_list sl;
+	FILE *stream;
+	size_t i, j, nk = 0, n = 500000, hits = 0;
+	double ms;
+	long len;
+
+	if (argc > 1) {
+		n = strtoul(argv[1], NULL, 10);
+	}
+	stream = bench_list(n);
+	if (!stream) {
+		printf("Failed to write the list\n");
+		return 1;
+	}
+	len = ftell(stream);
+	simd_init();
+	k[nk++] = (struct kernel){"scalar", scan_field_c, key_find_c, NULL};
+#ifdef SIMD_X86
+	k[nk++] = (struct kernel){"sse2", scan_field_sse2, key_find_sse2,
+	    NULL};
+	if (__builtin_cpu_supports("avx2")) {
+		k[nk++] = (struct kernel){"avx2", scan_field_avx2,
+		    key_find_sse2, key_find_avx2};
+	}
+#endif
+
+	printf("parse_stations, %zu stations, best of %d:\n", n, BENCH_RUNS);
+	for (i = 0; i < nk; i++) {
+		scan_field = k[i].scan;
+		ms = bench_parse(stream);
+		if (ms < 0) {
+			printf("Failed to parse the list\n");
+			return 1;
+		}
+		printf("  %-8s %8.1f ms %6.2f GB/s\n", k[i].name, ms,
+		    len / ms / 1e6);
+	}
+
+	scan_field = k[nk - 1].scan;
+	rewind(stream);
+	if (station_list_init(&sl, "bench") < 0
+	    || map_stations(&sl, stream) < 0 || parse_stations(&sl) < 0) {
+		printf("Failed to parse the list\n");
+		return 1;
+	}
+	printf("key_find over %zu keys, best of %d:\n", sl.nrec, BENCH_RUNS);
+	printf("  %-14s", "query");
+	for (i = 0; i < nk; i++) {
+		printf(" %10s", k[i].name);
+	}
+	printf("   hits\n");
+	for (j = 0; j < sizeof(queries) / sizeof(queries[0]); j++) {
+		printf("  %-14s", queries[j]);
+		for (i = 0; i < nk; i++) {
+			key_find = k[i].find;
+			key_find_long = k[i].find_long;
+			ms = bench_find(&sl, queries[j], &hits);
+			printf(" %7.1f ms", ms);
+		}
+		printf(" %6zu\n", hits);
+	}
+	station_list_free(&sl);
+	fclose(stream);
+	return 0;
+}
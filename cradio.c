@@ -1,24 +1,115 @@
 #define TB_IMPL
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <mpv/client.h>
 
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
 #include "termbox2.h"
+#include "fold.h"
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
+/* ASCII lower case of the byte c, as tolower in the C locale */
+#define FOLD(c) ((unsigned char)(c) \
+    | ((unsigned char)((unsigned char)(c) - 'A') < 26) << 5)
 
 #define MPV_FORMAT_OSD_STRING 2
 
+/* field offset refers to the stations file mapping, not the pool */
+#define F_MAP ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+/* the first slice is small so the first screenful shows up quickly */
+#define PARSE_FIRST (64 << 10)
+#define PARSE_CHUNK (4 << 20)
+
+/* station ids per block of the list order */
+#define BLOCK_SZ 256
+/* bits in the byte and byte pair signature of a block */
+#define SIG_BITS 2048
+/* ids indexed for search per pass of the main loop */
+#define INDEX_STEP 8192
+/* trigrams held by more than 1/INDEX_COMMON of the list are left to scans */
+#define INDEX_COMMON 64
+/* stations checked against the filter per pass of the main loop */
+#define FILTER_STEP 8192
+/* fuzzy matches kept for the ranked view */
+#define FUZZY_TOP 256
+/* fewest stations worth a scoring thread of their own */
+#define FUZZY_PART 65536
+/* searches whose matches are kept, and the most ids kept over them all */
+#define QCACHE_N 8
+#define QCACHE_IDS (1 << 21)
+/* stations a background search checks between chances to cancel it */
+#define SEARCH_SLICE 16384
+
+/* query prefix that makes a search a regular expression */
+#define RE_MARK '~'
+/* terms of a query naming fields, past which terms are ignored */
+#define QUERY_TERMS 16
+/* states a pattern may compile to, which bounds counted repeats */
+#define RE_STATES 4096
+/* dfa states cached before the cache is dropped and built again */
+#define RE_CACHE 2048
+/* moves to a state that has matched, or that never can */
+#define RE_YES (-2)
+#define RE_NO (-3)
+
+/* fuzzy match scores, as in fzf */
+#define FUZZY_MATCH 16
+#define FUZZY_GAP_START (-3)
+#define FUZZY_GAP (-1)
+#define FUZZY_BOUNDARY 8
+#define FUZZY_DIGIT 7
+#define FUZZY_RUN 4
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+#define CACHE_MAGIC "cradio\0c"
+#define CACHE_VERSION 2
+
+#define JOURNAL_MAGIC "cradio\0j"
+#define JOURNAL_VERSION 1
+/* journal size that triggers merging it into the stations file */
+#define JOURNAL_MAX (1 << 20)
+/* seconds between saves of a changed list */
+#define AUTOSAVE_SEC 30
+/* times the wait doubles after saves that failed, at most */
+#define SAVE_BACKOFF 4
+/* ms between redraws of the progress of loading or of a search */
+#define DRAW_MS 100
+
 #define ENTER 13
 #define ESC 27
 #define BACKSPACE 127
 
-enum state { NORMAL, SEARCH, EDIT_N, EDIT_U };
+enum state { NORMAL, SEARCH, EDIT_N, EDIT_U, FUZZY };
+
+enum journal_op { J_ADD = 'a', J_NAME = 'n', J_URL = 'u', J_DEL = 'x',
+	J_SWAP = 's' };
+
+enum job { JOB_NONE, JOB_NARROW, JOB_FUZZY };
+
+/* cursor move made once a narrowing job is done */
+enum then { THEN_NONE, THEN_INC, THEN_NEXT, THEN_PREV };
+
+/* field a query term is matched against, named before a colon */
+enum term { TERM_NAME, TERM_URL, TERM_HOST };
 
 struct player {
 	mpv_handle *ctx;
@@ -27,42 +118,679 @@ struct player {
 	int paused;
 	char cmd[2048];
 	char msg[256];
-	char *cur_station;
+	char cur_station[256];
+	/* media title, fetched again when mpv says it changed */
+	char title[256];
+};
+
+/*
+ * string in the station list pool (NUL terminated) or, with F_MAP set,
+ * referenced in place in the stations file (not NUL terminated)
+ */
+struct field {
+	size_t off;
+	size_t len;
 };
 
+/* key is the name folded for search, or the name itself if that is */
 struct station {
-	char *name;
-	char *url;
+	struct field name;
+	struct field url;
+	struct field key;
+};
+
+/*
+ * strings are never changed once added, so a snapshot can share buf;
+ * refs counts the sharers and is NULL while the pool owns it alone
+ */
+struct pool {
+	char *buf;
+	size_t len;
+	size_t sz;
+	size_t *refs;
+};
+
+/*
+ * run of station ids, in list order; idx is its place among the blocks,
+ * and sig has a bit set for each byte and pair of adjacent bytes in their
+ * keys, so scans skip blocks lacking one of the query
+ */
+struct block {
+	size_t n;
+	size_t idx;
+	/* false once ids, their keys or urls change, until sig is made again */
+	bool sig_ok;
+	uint64_t sig[SIG_BITS / 64];
+	/* the same over the urls */
+	uint64_t usig[SIG_BITS / 64];
+	size_t ids[BLOCK_SZ];
+};
+
+/* ids of the stations holding a name trigram, or on a host, ascending */
+struct posting {
+	uint32_t key;
+	uint32_t n;
+	uint32_t a;
+	uint32_t *ids;
+};
+
+enum re_op { RE_SET, RE_NOP, RE_SPLIT, RE_BOL, RE_EOL, RE_MATCH };
+
+/* nfa state: RE_SET consumes a byte in set[set], the others none */
+struct re_node {
+	enum re_op op;
+	int out;
+	int out1;
+	int set;
+};
+
+/* dfa state, standing for the nfa states list[off] to list[off + n - 1] */
+struct re_dfa {
+	size_t off;
+	size_t n;
+	uint64_t h;
+	int chain;
+	bool match;
+	/* whether it matches at the end of the string, -1 until known */
+	signed char end;
+};
+
+/*
+ * a pattern compiled to an nfa and run as a dfa made lazily: a dfa state
+ * is built the first time a byte leads to it, so time stays linear in
+ * the input whatever the pattern
+ */
+struct regex {
+	struct re_node *node;
+	size_t n;
+	size_t a;
+	uint64_t (*set)[4];
+	size_t nset;
+	size_t aset;
+	int start;
+	/* bytes no set tells apart share a class, and a dfa column */
+	uint8_t cls[256];
+	uint8_t rep[256];
+	size_t ncls;
+	struct re_dfa *dfa;
+	size_t ndfa;
+	/*
+	 * ndfa rows of ncls moves, each the row of the state moved to,
+	 * RE_YES or RE_NO if that ends the search, or -1 if not made yet
+	 */
+	int *next;
+	int *tab;
+	int *list;
+	size_t nlist;
+	size_t alist;
+	int init;
+	unsigned long flushes;
+	/* scratch for making states */
+	uint32_t *mark;
+	uint32_t gen;
+	int *stack;
+	int *tmp;
+	const char *err;
+};
+
+/*
+ * terms that must all match, folded: a plain query is one name term,
+ * a query naming fields one term a word
+ */
+struct query {
+	struct {
+		enum term f;
+		const char *v;
+		size_t len;
+	} t[QUERY_TERMS];
+	size_t n;
+	/* signatures a block needs in its names and its urls */
+	uint64_t sig[SIG_BITS / 64];
+	uint64_t usig[SIG_BITS / 64];
+	char buf[2048];
+};
+
+/*
+ * ids matching each prefix of the folded query, in list order; the
+ * levels lie back to back in ids, level k from lv[k], and each one only
+ * filters the one before, as a name holding a query holds its prefixes
+ */
+struct narrow {
+	char q[2048];
+	/*
+	 * level k is for the first base + k + 1 bytes of q and holds ids
+	 * lv[k] up to lv[k + 1], so a level being built past lv[nlv] is not
+	 * seen; levels built afresh rather than typed start at the whole
+	 * query
+	 */
+	size_t base;
+	size_t lv[2048];
+	size_t nlv;
+	size_t *ids;
+	size_t len;
+	size_t a_len;
+	/* q is a regular expression or names fields, with a single level */
+	bool whole;
+	/* list the levels were taken from */
+	unsigned long gen;
+	size_t size;
+	/* cursor when the search began */
+	size_t from;
+	size_t from_pg;
+};
+
+/*
+ * ids of the stations matching the filter query, in list order, so row
+ * r of the view is ids[r]; found a slice at a time up to position next
+ */
+struct filter {
+	bool on;
+	bool regex;
+	/* compiled query, or NULL if it does not compile */
+	struct regex *re;
+	/* the query otherwise */
+	struct query fq;
+	size_t *ids;
+	size_t n;
+	size_t a;
+	size_t next;
+	/* list the ids were taken from */
+	unsigned long gen;
+	/* first row on screen */
+	size_t pg;
+};
+
+/* matches of a past search, in list order, while the list is at gen */
+struct qentry {
+	char q[2048];
+	/* q compiled, if a regular expression, to check changes against */
+	struct regex *re;
+	/* q parsed, if it names fields */
+	struct query *fq;
+	size_t *ids;
+	size_t n;
+	unsigned long gen;
+	unsigned long used;
+};
+
+/* recent searches, the least recently used making way for new ones */
+struct qcache {
+	struct qentry e[QCACHE_N];
+	size_t n;
+	size_t ids;
+	unsigned long tick;
+};
+
+/* fuzzy match, ranked by score, then shorter name, then list order */
+struct hit {
+	int score;
+	size_t len;
+	size_t pos;
+	size_t id;
+};
+
+/* blocks [b0, b1) scored by one thread, its best in a heap worst first */
+struct rank {
+	const struct station_list *sl;
+	const char *q;
+	size_t b0;
+	size_t b1;
+	size_t pos;
+	struct hit *heap;
+	size_t n;
+	size_t matched;
+};
+
+/*
+ * threads kept for fuzzy_rank: each round they claim parts[next++] until
+ * all n are taken, and the last to finish one signals done
+ */
+struct rank_pool {
+	pthread_t *threads;
+	size_t nthreads;
+	bool quit;
+	struct rank *parts;
+	size_t n;
+	size_t next;
+	size_t finished;
+	pthread_mutex_t lock;
+	pthread_cond_t go;
+	pthread_cond_t done;
+};
+
+/* best fuzzy matches for q, best first, shown in place of the list */
+struct fuzzy {
+	char q[2048];
+	struct hit *hits;
+	size_t n;
+	size_t a;
+	size_t matched;
+	size_t size;
+	unsigned long edit_gen;
+	size_t row;
+	size_t pg;
+	struct rank_pool workers;
+};
+
+/*
+ * search run by a worker thread, a slice at a time under the list lock;
+ * bumping seq cancels the job under way, and the worker is done with
+ * job seq when done == seq
+ */
+struct search {
+	pthread_t thread;
+	bool started;
+	bool quit;
+	unsigned long seq;
+	unsigned long done;
+	/* job last reported by the ui */
+	unsigned long seen;
+	bool failed;
+	/* in a job, perhaps one cancelled but not yet let go of */
+	bool busy;
+	enum job job;
+	enum then then;
+	char q[2048];
+	/* list the job was asked for */
+	unsigned long gen;
+	size_t size;
+	/* progress through the stations to check */
+	size_t pos;
+	size_t total;
+	/* signalled with the list lock held when there is a job */
+	pthread_cond_t wake;
+	/* threads waiting for the list lock, which the worker hands over */
+	pthread_mutex_t lock;
+	pthread_cond_t turn;
+	int want;
+};
+
+/* what a row of the screen shows, id SIZE_MAX for nothing */
+struct shown {
+	size_t id;
+	bool hl;
+};
+
+/* the screen as last drawn, so that a frame redraws only what changed */
+struct screen {
+	int w;
+	int h;
+	/* false until drawn whole at this size */
+	bool ok;
+	/* list drawn from, its names perhaps edited since */
+	unsigned long gen;
+	struct shown *rows;
+	char *bar;
+};
+
+/* slice of the stations file, parsed into a flat list of fields */
+struct chunk {
+	const char *base;
+	const char *p;
+	const char *end;
+	struct field *fields;
+	size_t n;
+	size_t a_size;
+	struct pool pool;
+	size_t lines;
+	const char *err;
+	bool done;
+};
+
+/* chunks handed out to parser threads, merged in order by the loader */
+struct parse {
+	struct chunk *chunks;
+	size_t n;
+	size_t next;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
 };
 
+/* binary cache layout: header, record table, then string data */
+struct cache_hdr {
+	char magic[8];
+	uint64_t version;
+	uint64_t src_size;
+	int64_t src_sec;
+	int64_t src_nsec;
+	uint64_t src_ino;
+	uint64_t src_hash;
+	uint64_t count;
+	uint64_t size;
+};
+
+/* offsets are from the start of the cache file */
+struct cache_rec {
+	uint64_t name_off;
+	uint64_t name_len;
+	uint64_t url_off;
+	uint64_t url_len;
+	uint64_t key_off;
+	uint64_t key_len;
+};
+
+/* edit journal layout: header, then records each followed by len bytes */
+struct journal_hdr {
+	char magic[8];
+	uint64_t version;
+	uint64_t src_size;
+	uint64_t src_ino;
+	int64_t src_sec;
+	int64_t src_nsec;
+};
+
+/*
+ * J_ADD: a, b are the name and url lengths; J_NAME, J_URL: a is the
+ * position; J_DEL: a is the position; J_SWAP: a, b are the positions
+ */
+struct journal_rec {
+	uint32_t op;
+	uint32_t len;
+	uint64_t a;
+	uint64_t b;
+	uint64_t sum;
+};
+
+/*
+ * the list order copied, sharing the string pool, written out while the
+ * list keeps changing
+ */
+struct snapshot {
+	struct station *stations;
+	size_t size;
+	const char *map;
+	char *pool;
+	size_t *refs;
+	const char *path;
+	unsigned long gen;
+	struct stat st;
+	double ms;
+	int rv;
+};
+
+/*
+ * stations holds the records by id; the list order is a sequence of
+ * blocks of ids with a Fenwick tree over the block sizes, so finding a
+ * position is O(log n), and inserting or removing one O(log n +
+ * BLOCK_SZ). Splitting a full block or dropping an empty one shifts
+ * the blocks and rebuilds the tree, O(n / BLOCK_SZ), but a split comes
+ * at most once every BLOCK_SZ / 2 inserts
+ */
 struct station_list {
-	struct station **stations;
+	struct station *stations;
+	size_t nrec;
+	size_t *free_ids;
+	size_t nfree;
+	struct block **blocks;
+	size_t nblocks;
+	size_t a_blocks;
+	size_t *fen;
+	/* block holding each live id, NULL for free ids */
+	struct block **owner;
+	/* index of the name trigrams and hosts of ids below tri_next */
+	struct posting *tri;
+	size_t tri_sz;
+	size_t tri_n;
+	size_t tri_next;
+	/* the index was given up on for want of memory, search scans */
+	bool tri_off;
+	/* blocks below sig_next have had their signature made */
+	size_t sig_next;
+	/* candidates of the search being typed */
+	struct narrow nar;
+	/* stations shown while filtering by a search */
+	struct filter filt;
+	/* matches of recent searches */
+	struct qcache qc;
+	/* ranked view of a fuzzy search */
+	struct fuzzy fz;
+	struct search srch;
+	struct screen scr;
+	struct pool pool;
+	char *map;
+	size_t map_sz;
+	bool mapped;
 	size_t index;
 	size_t pg_i;
 	size_t size;
 	size_t a_size;
 	size_t *sel;
+	/* bumped by every change; saved_gen is what the stations file holds */
+	unsigned long gen;
+	unsigned long saved_gen;
+	/* gen of the last change that was not an append */
+	unsigned long edit_gen;
 	enum state state;
 	char *path;
+	/* held by the ui while drawing or handling input, and by the loader */
+	pthread_mutex_t lock;
+	pthread_t loader;
+	bool loading;
+	size_t load_pos;
+	struct stat src;
+	char err[256];
+	/* edit journal, merged into the stations file by a compactor thread */
+	int jfd;
+	off_t jlen;
+	off_t jmark;
+	struct snapshot *snap;
+	pthread_t compactor;
+	bool compact_done;
+	/* last save tried, and how many in a row failed */
+	struct timespec saved_at;
+	int save_fails;
+	/* self-pipe: a byte written to wake[1] wakes the ui from poll */
+	int wake[2];
 };
 
 static size_t strcpy_t(char *, const char *, size_t);
+static void simd_init(void);
+static const char *scan_field_c(const char *, const char *);
+#ifdef SIMD_X86
+static const char *scan_field_sse2(const char *, const char *);
+static const char *scan_field_avx2(const char *, const char *)
+    __attribute__((target("avx2")));
+#endif
+static int pool_reserve(struct pool *, size_t);
+static int pool_add(struct pool *, const char *, size_t, struct field *);
+static int key_make(struct pool *, const char *, struct field,
+    struct field *);
+static void pool_release(char *, size_t *);
+static const char *field_ptr(const struct station_list *, struct field);
+static size_t field_copy(const struct station_list *, struct field, char *,
+    size_t);
+static uint64_t hash(uint64_t, const char *, size_t);
+static char *path_ext(const char *, const char *);
+static int dir_sync(const char *);
+static double elapsed_ms(const struct timespec *);
+static void fen_add(struct station_list *, size_t, int);
+static void fen_build(struct station_list *);
+static size_t fen_sum(const struct station_list *, size_t);
+static size_t fen_find(const struct station_list *, size_t, size_t *);
+static int block_insert(struct station_list *, size_t);
+static int seq_insert(struct station_list *, size_t, size_t);
+static size_t seq_delete(struct station_list *, size_t);
+static size_t *seq_ref(const struct station_list *, size_t);
+static struct station *station_at(const struct station_list *, size_t);
+static size_t seq_pos(const struct station_list *, size_t);
+static void sig_add(uint64_t *, const char *, size_t);
+static bool sig_has(const uint64_t *, const uint64_t *);
+static const uint64_t *block_sig(const struct station_list *,
+    struct block *);
+static bool block_fits(const struct station_list *, struct block *,
+    const struct query *);
+static void sig_step(struct station_list *, size_t);
+static uint32_t tri_key(const char *);
+static const char *url_host(const char *, size_t, size_t *);
+static uint32_t host_key(const char *, size_t);
+static struct posting *tri_get(struct station_list *, uint32_t, bool);
+static size_t posting_find(const struct posting *, size_t);
+static int posting_add(struct station_list *, uint32_t, size_t);
+static void posting_remove(struct station_list *, uint32_t, size_t);
+static int index_add(struct station_list *, size_t);
+static void index_remove(struct station_list *, size_t);
+static void index_step(struct station_list *, size_t);
+static void index_clear(struct station_list *);
+static void index_drop(struct station_list *);
+static ssize_t index_query(struct station_list *, const char *, uint32_t **);
+static ssize_t host_query(struct station_list *, const char *, uint32_t **);
 static int station_list_init(struct station_list *, char *);
-static int station_list_save(const struct station_list *);
+static int station_list_reserve(struct station_list *, size_t);
+static int station_list_add(struct station_list *, struct field,
+    struct field, const struct field *);
+static int station_list_compact(struct station_list *);
+static int station_list_save(struct station_list *);
 static int station_list_swap(struct station_list *, size_t, size_t);
-static int player_init(struct player *);
+static int station_list_edit(struct station_list *, size_t, bool,
+    const char *, size_t);
+static void station_list_clear(struct station_list *);
+static void station_list_free(struct station_list *);
+static void list_wake(void *);
+static int player_init(struct player *, struct station_list *);
+static bool player_events(struct player *);
 static int vol_add(struct player *);
 static int vol_mute(struct player *);
 static int vol_sub(struct player *);
 static int stop(struct player *);
-static int play(struct player *, struct station);
-static int parse_stations(struct station_list *, FILE *);
-static int search_f(struct station_list *, const char *);
-static int search_r(struct station_list *, const char *);
-static int io_read(struct station_list *, struct player *);
-static char *strstr_i(const char *, const char*);
+static int play(struct player *, const struct station_list *,
+    const struct station *);
+static int map_stations(struct station_list *, FILE *);
+static const char *unescape(struct pool *, const char *, const char *,
+    struct field *);
+static void *parse_chunk(void *);
+static void *parse_worker(void *);
+static int parse_stations(struct station_list *);
+static void *load_stations(void *);
+static int cache_load(struct station_list *, FILE *);
+static int cache_write(const struct snapshot *, const struct stat *,
+    uint64_t);
+static struct snapshot *snapshot_take(struct station_list *);
+static const char *snap_ptr(const struct snapshot *, struct field);
+static void *snapshot_write(void *);
+static void snapshot_free(struct snapshot *);
+static int journal_check(int, const struct stat *);
+static int journal_new(const char *, const struct stat *, const char *,
+    size_t);
+static int journal_replay(struct station_list *, int);
+static int journal_open(struct station_list *);
+static int journal_append(struct station_list *, enum journal_op, uint64_t,
+    uint64_t, const char *, size_t, const char *, size_t);
+static void *compact_run(void *);
+static int compact_start(struct station_list *);
+static int compact_finish(struct station_list *);
+static double save_wait(const struct station_list *);
+static int re_node(struct regex *, enum re_op, int, int, int);
+static int re_byte(struct regex *, const uint64_t *, int *, int *);
+static int re_empty(struct regex *, enum re_op, int *, int *);
+static void re_cat(struct regex *, int *, int *, int, int);
+static int re_repeat(struct regex *, int, int *, int *);
+static int re_or(struct regex *, int *, int *, int, int);
+static int re_char(struct regex *, const char *, size_t, int *, int *);
+static int re_multi(struct regex *, int *, int *);
+static size_t re_len(const char *);
+static bool re_perl(int, uint64_t *);
+static int re_class(struct regex *, const char **, int *, int *);
+static int re_atom(struct regex *, const char **, int *, int *);
+static size_t re_count(const char *, int *, int *);
+static int re_piece(struct regex *, const char **, const char *, int *,
+    int *);
+static int re_alt(struct regex *, const char **, int *, int *);
+static struct regex *regex_new(const char *, const char **);
+static void regex_free(struct regex *);
+static void re_flush(struct regex *);
+static void re_close(struct regex *, int, bool, bool);
+static void re_mark(struct regex *);
+static int re_state(struct regex *);
+static int re_step(struct regex *, int, int);
+static bool re_end(struct regex *, int, bool);
+static int regex_match(struct regex *, const char *, size_t);
+static int station_regex(const struct station_list *, struct regex *,
+    const struct station *);
+static enum term term_field(const char *, size_t *);
+static bool query_fields(const char *);
+static bool search_whole(const char *);
+static void query_parse(struct query *, const char *);
+static bool url_find(const char *, size_t, const char *, size_t);
+static bool query_match(const struct station_list *, const struct query *,
+    size_t);
+static void search_query(char *, size_t, const char *);
+static int size_cmp(const void *, const void *);
+static size_t seq_rank(const struct station_list *, const size_t *, size_t,
+    size_t);
+static int narrow_reserve(struct narrow *, size_t);
+static int narrow_seed(struct station_list *, const char *);
+static int narrow_lookup(struct station_list *, const struct query *);
+static int narrow_whole(struct station_list *, const char *);
+static int narrow_push(struct station_list *, const char *);
+static int narrow_sync(struct station_list *, const char *);
+static size_t *narrow_top(const struct station_list *, const char *,
+    size_t *);
+static struct qentry *qcache_find(struct station_list *, const char *);
+static void qcache_drop(struct station_list *, size_t);
+static void qcache_put(struct station_list *, const char *, const size_t *,
+    size_t);
+static unsigned qcache_hits(struct station_list *, size_t);
+static void qcache_sync(struct station_list *, unsigned, unsigned long);
+static int narrow_cached(struct station_list *, const char *);
+static size_t *search_top(struct station_list *, const char *, size_t *);
+static void search_keep(struct station_list *, const char *);
+static void search_inc(struct station_list *, const char *);
+static void filter_start(struct station_list *, const char *);
+static int filter_step(struct station_list *, size_t);
+static void filter_snap(struct station_list *);
+static void filter_move(struct station_list *, int);
+static void filter_drop(struct station_list *, size_t, size_t);
+static int fuzzy_class(int);
+static int fuzzy_score(const char *, size_t, const char *, size_t);
+static bool hit_better(const struct hit *, const struct hit *);
+static int hit_cmp(const void *, const void *);
+static void hit_push(struct hit *, size_t *, struct hit);
+static void rank_run(struct rank *);
+static void *rank_work(void *);
+static void rank_start(struct rank_pool *, size_t);
+static void rank_round(struct rank_pool *, struct rank *, size_t);
+static void rank_stop(struct rank_pool *);
+static int fuzzy_rank(struct station_list *, const char *);
+static void fuzzy_sync(struct station_list *, const char *);
+static void search_f(struct station_list *, const char *);
+static void search_r(struct station_list *, const char *);
+static void list_lock(struct station_list *);
+static bool search_yield(struct station_list *, size_t, size_t);
+static void search_job(struct station_list *);
+static void *search_run(void *);
+static void search_want(struct station_list *, enum job, const char *,
+    enum then);
+static void search_cancel(struct station_list *);
+static void search_stop(struct station_list *);
+static void search_poll(struct station_list *, struct player *);
+static int io_handle(struct station_list *, struct player *,
+    const struct tb_event *);
+static bool io_read(struct station_list *, struct player *, int);
+static size_t key_fold(char *, size_t, const char *, size_t);
+static const char *key_find_c(const char *, size_t, const char *);
+#ifdef SIMD_X86
+static const char *key_find_sse2(const char *, size_t, const char *);
+static const char *key_find_avx2(const char *, size_t, const char *)
+    __attribute__((target("avx2")));
+#endif
+static size_t subseq_c(const char *, size_t, const char *, size_t);
+#ifdef SIMD_X86
+static size_t subseq_sse2(const char *, size_t, const char *, size_t);
+#endif
+static int screen_fit(struct screen *, int, int);
 static void station_list_render(struct station_list *, struct player *);
 
+/* first '"', '\\' or '\n' in [p, end), or end */
+static const char *(*scan_field)(const char *, const char *) = scan_field_c;
+/* first match of tgt in the len bytes of a search key at src, or NULL */
+static const char *(*key_find)(const char *, size_t, const char *)
+    = key_find_c;
+/* the same for long keys, where wider vectors pay off */
+static const char *(*key_find_long)(const char *, size_t, const char *);
+/* end of the first match of the bytes of q, in order, in key s; or 0 */
+static size_t (*subseq)(const char *, size_t, const char *, size_t)
+    = subseq_c;
+
 size_t
 strcpy_t(char *dest, const char *src, size_t size)
 {
@@ -77,407 +805,4993 @@ strcpy_t(char *dest, const char *src, size_t size)
 	return i;
 }
 
-char *
-strstr_i(const char *src, const char *tgt)
+void
+simd_init(void)
 {
-	size_t i;
-	int c = tolower((unsigned char)*tgt);
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	key_find = key_find_sse2;
+	subseq = subseq_sse2;
+	if (__builtin_cpu_supports("avx2")) {
+		scan_field = scan_field_avx2;
+		key_find_long = key_find_avx2;
+	} else {
+		scan_field = scan_field_sse2;
+	}
+#endif
+}
 
-	if (c == '\0') {
-		return (char *)src;
+const char *
+scan_field_c(const char *p, const char *end)
+{
+	for (; p < end; p++) {
+		if (*p == '\"' || *p == '\\' || *p == '\n') {
+			break;
+		}
 	}
-	for (; *src; src++) {
-		if (tolower((unsigned char)*src) == c) {
-			for (i = 1;; i++) {
-				if (tgt[i] == '\0') {
-					return (char *)src;
-				}
-				if (tolower((unsigned char)src[i])
-				    != tolower((unsigned char)tgt[i])) {
-					break;
-				}
+	return p;
+}
+
+#ifdef SIMD_X86
+const char *
+scan_field_sse2(const char *p, const char *end)
+{
+	const __m128i q = _mm_set1_epi8('\"');
+	const __m128i b = _mm_set1_epi8('\\');
+	const __m128i n = _mm_set1_epi8('\n');
+	__m128i v;
+	int m;
+
+	for (; end - p >= 16; p += 16) {
+		v = _mm_loadu_si128((const __m128i *)p);
+		m = _mm_movemask_epi8(_mm_or_si128(
+		    _mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, b)),
+		    _mm_cmpeq_epi8(v, n)));
+		if (m) {
+			return p + __builtin_ctz(m);
+		}
+	}
+	return scan_field_c(p, end);
+}
+
+const char *
+scan_field_avx2(const char *p, const char *end)
+{
+	const __m256i q = _mm256_set1_epi8('\"');
+	const __m256i b = _mm256_set1_epi8('\\');
+	const __m256i n = _mm256_set1_epi8('\n');
+	__m256i v;
+	unsigned int m;
+
+	for (; end - p >= 32; p += 32) {
+		v = _mm256_loadu_si256((const __m256i *)p);
+		m = _mm256_movemask_epi8(_mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(v, q),
+		    _mm256_cmpeq_epi8(v, b)), _mm256_cmpeq_epi8(v, n)));
+		if (m) {
+			return p + __builtin_ctz(m);
+		}
+	}
+	return scan_field_sse2(p, end);
+}
+#endif
+
+/*
+ * search key of the len bytes at s in at most size - 1 bytes at d, NUL
+ * terminated; the length written. ASCII and the letters in fold.h are
+ * folded, combining marks dropped and full width forms narrowed, so
+ * keys compare byte for byte. Bytes that are not UTF-8 are kept as is
+ */
+size_t
+key_fold(char *d, size_t size, const char *s, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)s;
+	const unsigned char *end = p + len;
+	uint64_t w, m, hi = 0x8080808080808080ull, one = 0x0101010101010101ull;
+	uint32_t cp;
+	size_t n = 0, k;
+
+	for (; p < end && n + 1 < size; p += k) {
+		/* eight ASCII bytes at a time, upper case bytes get 0x20 */
+		if (end - p >= 8 && n + 9 <= size) {
+			memcpy(&w, p, 8);
+			if (!(w & hi)) {
+				m = (w + one * (0x80 - 'A')) & ~(w + one
+				    * (0x80 - 'Z' - 1)) & hi;
+				w |= m >> 2;
+				memcpy(d + n, &w, 8);
+				n += 8;
+				k = 8;
+				continue;
 			}
 		}
+		cp = *p;
+		k = 1;
+		if (cp >= 0xc2 && cp < 0xe0 && end - p > 1
+		    && (p[1] & 0xc0) == 0x80) {
+			cp = (cp & 0x1f) << 6 | (p[1] & 0x3f);
+			k = 2;
+		} else if (cp >= 0xe0 && cp < 0xf0 && end - p > 2
+		    && (p[1] & 0xc0) == 0x80 && (p[2] & 0xc0) == 0x80
+		    && (cp > 0xe0 || p[1] >= 0xa0)) {
+			cp = (cp & 0x0f) << 12 | (p[1] & 0x3f) << 6
+			    | (p[2] & 0x3f);
+			k = 3;
+		}
+		if (k == 1) {
+			d[n++] = cp < 0x80 ? FOLD(cp) : cp;
+			continue;
+		}
+		if (cp >= 0x300 && cp < 0x370) {
+			continue;
+		} else if (cp >= 0xa0 && cp < 0x500 && fold_lat[cp - 0xa0]) {
+			cp = fold_lat[cp - 0xa0];
+		} else if (cp >= 0x1e00 && cp < 0x1f00
+		    && fold_ext[cp - 0x1e00]) {
+			cp = fold_ext[cp - 0x1e00];
+		} else if (cp >= 0xff01 && cp <= 0xff5e) {
+			cp = FOLD(cp - 0xfee0);
+		}
+		if (cp < 0x80) {
+			d[n++] = cp;
+		} else if (cp < 0x800 && n + 2 < size) {
+			d[n++] = 0xc0 | cp >> 6;
+			d[n++] = 0x80 | (cp & 0x3f);
+		} else if (cp >= 0x800 && n + 3 < size) {
+			d[n++] = 0xe0 | cp >> 12;
+			d[n++] = 0x80 | (cp >> 6 & 0x3f);
+			d[n++] = 0x80 | (cp & 0x3f);
+		} else {
+			break;
+		}
+	}
+	if (size > 0) {
+		d[n] = '\0';
+	}
+	return n;
+}
+
+/* memchr, vectorized by libc, finds the candidates for the first byte */
+const char *
+key_find_c(const char *src, size_t len, const char *tgt)
+{
+	size_t k = strlen(tgt);
+	const char *p = src, *end;
+
+	if (k == 0) {
+		return src;
+	}
+	if (len < k) {
+		return NULL;
+	}
+	end = src + len - k + 1;
+	while ((p = memchr(p, tgt[0], end - p))) {
+		if (p[k - 1] == tgt[k - 1]
+		    && memcmp(p + 1, tgt + 1, k > 1 ? k - 2 : 0) == 0) {
+			return p;
+		}
+		p++;
 	}
 	return NULL;
 }
 
-int
-station_list_init(struct station_list *sl, char *path)
+#ifdef SIMD_X86
+/*
+ * compare the first and last byte of tgt against 16 positions at once,
+ * then check the rest at each position where both match. The last
+ * positions are taken from a window ending at the end of src; a src
+ * shorter than that window goes to key_find_c
+ */
+const char *
+key_find_sse2(const char *src, size_t len, const char *tgt)
 {
-	sl->pg_i = 0;
-	sl->index = 0;
-	sl->size = 0;
-	sl->state = NORMAL;
-	sl->stations = malloc(sizeof(struct station) * 1024);
-	sl->a_size = 1024;
-	sl->path = path;
-	sl->sel = NULL;
-	if (!sl->stations) {
-		printf("Failed to allocate stations list\n");
-		return -1;
+	__m128i first, last, a, b;
+	size_t i, k = strlen(tgt);
+	const char *q;
+	unsigned int m, lim;
+
+	if (k == 0) {
+		return src;
+	}
+	if (key_find_long && len >= k - 1 + 64) {
+		return key_find_long(src, len, tgt);
+	}
+	first = _mm_set1_epi8(tgt[0]);
+	last = _mm_set1_epi8(tgt[k - 1]);
+	for (i = 0; i + k <= len; i += 16) {
+		if (i + k - 1 + 16 <= len) {
+			q = src + i;
+			lim = 0xffff;
+		} else if (len >= k - 1 + 16) {
+			q = src + len - (k - 1) - 16;
+			lim = 0xffff << (src + i - q) & 0xffff;
+		} else {
+			return key_find_c(src, len, tgt);
+		}
+		a = _mm_loadu_si128((const __m128i *)q);
+		b = _mm_loadu_si128((const __m128i *)(q + k - 1));
+		m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+		    _mm_cmpeq_epi8(b, last))) & lim;
+		for (; m; m &= m - 1) {
+			if (memcmp(q + __builtin_ctz(m) + 1, tgt + 1,
+			    k > 1 ? k - 2 : 0) == 0) {
+				return q + __builtin_ctz(m);
+			}
+		}
+	}
+	return NULL;
+}
+
+const char *
+key_find_avx2(const char *src, size_t len, const char *tgt)
+{
+	__m256i first, last, a, b;
+	size_t i, k;
+	const char *q;
+	unsigned int m, lim;
+
+	k = strlen(tgt);
+	if (k == 0 || len < k - 1 + 32) {
+		return key_find_c(src, len, tgt);
+	}
+	first = _mm256_set1_epi8(tgt[0]);
+	last = _mm256_set1_epi8(tgt[k - 1]);
+	for (i = 0; i + k <= len; i += 32) {
+		if (i + k - 1 + 32 <= len) {
+			q = src + i;
+			lim = 0xffffffff;
+		} else {
+			q = src + len - (k - 1) - 32;
+			lim = 0xffffffff << (src + i - q);
+		}
+		a = _mm256_loadu_si256((const __m256i *)q);
+		b = _mm256_loadu_si256((const __m256i *)(q + k - 1));
+		m = _mm256_movemask_epi8(_mm256_and_si256(
+		    _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)))
+		    & lim;
+		for (; m; m &= m - 1) {
+			if (memcmp(q + __builtin_ctz(m) + 1, tgt + 1,
+			    k > 1 ? k - 2 : 0) == 0) {
+				return q + __builtin_ctz(m);
+			}
+		}
+	}
+	return NULL;
+}
+#endif
+
+size_t
+subseq_c(const char *s, size_t len, const char *q, size_t qn)
+{
+	size_t i, j = 0;
+
+	for (i = 0; i < len; i++) {
+		if (s[i] == q[j] && ++j == qn) {
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+#ifdef SIMD_X86
+/* picks the query bytes in turn off the masks of 16 byte windows */
+size_t
+subseq_sse2(const char *s, size_t len, const char *q, size_t qn)
+{
+	__m128i v;
+	size_t i, j = 0, base;
+	const char *p;
+	char tmp[16];
+	unsigned int m, lim;
+	int k;
+
+	for (i = 0; i < len; i += 16) {
+		if (i + 16 <= len) {
+			p = s + i;
+			base = i;
+		} else if (len >= 16) {
+			/* the window ending at the end of s */
+			p = s + len - 16;
+			base = len - 16;
+		} else {
+			memset(tmp, 0, sizeof(tmp));
+			memcpy(tmp, s, len);
+			p = tmp;
+			base = 0;
+		}
+		lim = 0xffff << (i - base) & 0xffff;
+		v = _mm_loadu_si128((const __m128i *)p);
+		for (;;) {
+			m = _mm_movemask_epi8(_mm_cmpeq_epi8(v,
+			    _mm_set1_epi8(q[j]))) & lim;
+			if (!m) {
+				break;
+			}
+			k = __builtin_ctz(m);
+			if (++j == qn) {
+				return base + k + 1;
+			}
+			lim &= ~1u << k;
+		}
 	}
 	return 0;
 }
+#endif
 
 int
-station_list_add(struct station_list *sl, struct station *s)
+pool_reserve(struct pool *pool, size_t len)
 {
 	void *a_tmp;
+	size_t sz = pool->sz;
 
-	if (sl->size + 1 == sl->a_size) {
-		a_tmp = realloc(
-		    sl->stations,
-		    sizeof(struct station)
-			* (sl->a_size + 256));
-		if (!a_tmp) {
-			printf("Failed to resize station list\n");
-			return -1;
+	if (pool->len + len <= sz) {
+		return 0;
+	}
+	while (pool->len + len > sz) {
+		sz = sz ? sz * 2 : 4096;
+	}
+	if (pool->refs) {
+		/* a snapshot still reads the old buffer */
+		a_tmp = malloc(sz);
+		if (a_tmp && pool->len > 0) {
+			memcpy(a_tmp, pool->buf, pool->len);
+		}
+		if (a_tmp) {
+			pool_release(pool->buf, pool->refs);
+			pool->refs = NULL;
 		}
-		sl->stations = a_tmp;
-		sl->a_size += 256;
+	} else {
+		a_tmp = realloc(pool->buf, sz);
+	}
+	if (!a_tmp) {
+		printf("Failed to resize string pool\n");
+		return -1;
 	}
-	sl->stations[sl->size++] = s;
+	pool->buf = a_tmp;
+	pool->sz = sz;
 	return 0;
 }
 
+/* drop one reference to a pool buffer; the caller holds the list lock */
+void
+pool_release(char *buf, size_t *refs)
+{
+	if (!refs) {
+		free(buf);
+	} else if (--*refs == 0) {
+		free(buf);
+		free(refs);
+	}
+}
+
 int
-station_list_swap(struct station_list *sl, size_t oi, size_t ni)
+pool_add(struct pool *pool, const char *s, size_t len, struct field *f)
 {
-	struct station *tmp;
+	if (pool_reserve(pool, len + 1) < 0) {
+		return -1;
+	}
+	memcpy(pool->buf + pool->len, s, len);
+	pool->buf[pool->len + len] = '\0';
+	f->off = pool->len;
+	f->len = len;
+	pool->len += len + 1;
+	return 0;
+}
 
-	tmp = sl->stations[oi];
-	sl->stations[oi] = sl->stations[ni];
-	sl->stations[ni] = tmp;
-	free(sl->sel);
-	sl->sel = NULL;
+/*
+ * search key of the field f, whose bytes are in pool or, with F_MAP, in
+ * map: folded into pool, or f itself if folding leaves it as it is
+ */
+int
+key_make(struct pool *pool, const char *map, struct field f,
+    struct field *key)
+{
+	size_t n, sz = f.len + f.len / 2 + 1;
+	const char *s;
+	char *d;
+
+	if (pool_reserve(pool, sz) < 0) {
+		return -1;
+	}
+	s = f.off & F_MAP ? map + (f.off & ~F_MAP) : pool->buf + f.off;
+	d = pool->buf + pool->len;
+	n = key_fold(d, sz, s, f.len);
+	if (n == f.len && memcmp(d, s, n) == 0) {
+		*key = f;
+		return 0;
+	}
+	key->off = pool->len;
+	key->len = n;
+	pool->len += n + 1;
 	return 0;
 }
 
+const char *
+field_ptr(const struct station_list *sl, struct field f)
+{
+	if (f.off & F_MAP) {
+		return sl->map + (f.off & ~F_MAP);
+	}
+	return sl->pool.buf + f.off;
+}
+
+size_t
+field_copy(const struct station_list *sl, struct field f, char *dest,
+    size_t size)
+{
+	size_t len = 0;
+
+	if (size > 0) {
+		len = MIN(f.len, size - 1);
+		memcpy(dest, field_ptr(sl, f), len);
+		dest[len] = '\0';
+	}
+	return len;
+}
+
+/* FNV-1a, start with h = HASH_INIT */
+uint64_t
+hash(uint64_t h, const char *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* Fenwick tree over block sizes, fen[1..nblocks] */
+void
+fen_add(struct station_list *sl, size_t b, int delta)
+{
+	for (b++; b <= sl->nblocks; b += b & -b) {
+		sl->fen[b] += delta;
+	}
+}
+
+void
+fen_build(struct station_list *sl)
+{
+	size_t i, j;
+
+	for (i = 1; i <= sl->nblocks; i++) {
+		sl->fen[i] = sl->blocks[i - 1]->n;
+		sl->blocks[i - 1]->idx = i - 1;
+	}
+	for (i = 1; i <= sl->nblocks; i++) {
+		j = i + (i & -i);
+		if (j <= sl->nblocks) {
+			sl->fen[j] += sl->fen[i];
+		}
+	}
+}
+
+/* number of stations in the first b blocks */
+size_t
+fen_sum(const struct station_list *sl, size_t b)
+{
+	size_t sum = 0;
+
+	for (; b > 0; b -= b & -b) {
+		sum += sl->fen[b];
+	}
+	return sum;
+}
+
+/* block holding position pos < size, and the offset within it */
+size_t
+fen_find(const struct station_list *sl, size_t pos, size_t *off)
+{
+	size_t b = 0, step = 1;
+
+	while (step * 2 <= sl->nblocks) {
+		step *= 2;
+	}
+	for (; step > 0; step /= 2) {
+		if (b + step <= sl->nblocks && sl->fen[b + step] <= pos) {
+			b += step;
+			pos -= sl->fen[b];
+		}
+	}
+	*off = pos;
+	return b;
+}
+
+/* insert an empty block before block b */
 int
-station_list_delete(struct station_list *sl, size_t index)
+block_insert(struct station_list *sl, size_t b)
+{
+	struct block *blk;
+	void *a_tmp;
+	size_t n, k;
+
+	if (sl->nblocks == sl->a_blocks) {
+		n = sl->a_blocks ? sl->a_blocks * 2 : 64;
+		a_tmp = realloc(sl->blocks, sizeof(struct block *) * n);
+		if (!a_tmp) {
+			return -1;
+		}
+		sl->blocks = a_tmp;
+		a_tmp = realloc(sl->fen, sizeof(size_t) * (n + 1));
+		if (!a_tmp) {
+			return -1;
+		}
+		sl->fen = a_tmp;
+		sl->a_blocks = n;
+	}
+	blk = malloc(sizeof(struct block));
+	if (!blk) {
+		return -1;
+	}
+	blk->n = 0;
+	/* made between events, or by the first scan to need it */
+	blk->sig_ok = false;
+	memmove(sl->blocks + b + 1, sl->blocks + b,
+	    sizeof(struct block *) * (sl->nblocks - b));
+	sl->blocks[b] = blk;
+	sl->nblocks++;
+	if (b == sl->nblocks - 1) {
+		/* appended, only its own node needs computing */
+		blk->idx = b;
+		k = sl->nblocks;
+		sl->fen[k] = fen_sum(sl, k - 1) - fen_sum(sl, k - (k & -k));
+	} else {
+		fen_build(sl);
+	}
+	return 0;
+}
+
+int
+seq_insert(struct station_list *sl, size_t pos, size_t id)
+{
+	struct block *blk;
+	size_t b, off, k;
+
+	if (pos == sl->size) {
+		if (sl->nblocks == 0
+		    || sl->blocks[sl->nblocks - 1]->n == BLOCK_SZ) {
+			if (block_insert(sl, sl->nblocks) < 0) {
+				return -1;
+			}
+		}
+		b = sl->nblocks - 1;
+		off = sl->blocks[b]->n;
+	} else {
+		b = fen_find(sl, pos, &off);
+	}
+	blk = sl->blocks[b];
+	if (blk->n == BLOCK_SZ) {
+		/* split in half and insert into the half holding pos */
+		if (block_insert(sl, b + 1) < 0) {
+			return -1;
+		}
+		memcpy(sl->blocks[b + 1]->ids, blk->ids + BLOCK_SZ / 2,
+		    sizeof(size_t) * (BLOCK_SZ - BLOCK_SZ / 2));
+		sl->blocks[b + 1]->n = BLOCK_SZ - BLOCK_SZ / 2;
+		sl->blocks[b + 1]->sig_ok = false;
+		blk->n = BLOCK_SZ / 2;
+		blk->sig_ok = false;
+		for (k = 0; k < sl->blocks[b + 1]->n; k++) {
+			sl->owner[sl->blocks[b + 1]->ids[k]]
+			    = sl->blocks[b + 1];
+		}
+		fen_build(sl);
+		if (off > blk->n) {
+			off -= blk->n;
+			blk = sl->blocks[++b];
+		}
+	}
+	memmove(blk->ids + off + 1, blk->ids + off,
+	    sizeof(size_t) * (blk->n - off));
+	blk->ids[off] = id;
+	blk->n++;
+	sl->owner[id] = blk;
+	fen_add(sl, b, 1);
+	sl->size++;
+	return 0;
+}
+
+/* remove position pos < size, returning the id that was there */
+size_t
+seq_delete(struct station_list *sl, size_t pos)
+{
+	struct block *blk;
+	size_t b, off, id;
+
+	b = fen_find(sl, pos, &off);
+	blk = sl->blocks[b];
+	id = blk->ids[off];
+	sl->owner[id] = NULL;
+	memmove(blk->ids + off, blk->ids + off + 1,
+	    sizeof(size_t) * (blk->n - off - 1));
+	blk->n--;
+	sl->size--;
+	if (blk->n == 0) {
+		free(blk);
+		memmove(sl->blocks + b, sl->blocks + b + 1,
+		    sizeof(struct block *) * (sl->nblocks - b - 1));
+		sl->nblocks--;
+		fen_build(sl);
+	} else {
+		blk->sig_ok = false;
+		fen_add(sl, b, -1);
+	}
+	return id;
+}
+
+size_t *
+seq_ref(const struct station_list *sl, size_t pos)
+{
+	size_t b, off;
+
+	b = fen_find(sl, pos, &off);
+	return &sl->blocks[b]->ids[off];
+}
+
+struct station *
+station_at(const struct station_list *sl, size_t pos)
+{
+	return &sl->stations[*seq_ref(sl, pos)];
+}
+
+/* position of the live station id */
+size_t
+seq_pos(const struct station_list *sl, size_t id)
+{
+	const struct block *blk = sl->owner[id];
+	size_t off = 0;
+
+	while (blk->ids[off] != id) {
+		off++;
+	}
+	return fen_sum(sl, blk->idx) + off;
+}
+
+/* set the bits of the bytes and byte pairs of the len bytes at p in sig */
+void
+sig_add(uint64_t *sig, const char *p, size_t len)
+{
+	uint32_t h, c;
+	size_t i;
+
+	/* keys are folded already, urls are folded for ASCII only */
+	for (i = 0; i < len; i++) {
+		c = FOLD(p[i]);
+		h = (c | 0x10000) * 2654435761u >> 21;
+		sig[h / 64] |= (uint64_t)1 << (h % 64);
+		if (i > 0) {
+			h = ((uint32_t)FOLD(p[i - 1]) << 8 | c)
+			    * 2654435761u >> 21;
+			sig[h / 64] |= (uint64_t)1 << (h % 64);
+		}
+	}
+}
+
+/* whether sig has every bit of q */
+bool
+sig_has(const uint64_t *sig, const uint64_t *q)
+{
+	size_t i;
+
+	for (i = 0; i < SIG_BITS / 64; i++) {
+		if ((sig[i] & q[i]) != q[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* signature of the names in blk, and of its urls, made again if stale */
+const uint64_t *
+block_sig(const struct station_list *sl, struct block *blk)
+{
+	const struct station *s;
+	size_t i;
+
+	if (!blk->sig_ok) {
+		memset(blk->sig, 0, sizeof(blk->sig));
+		memset(blk->usig, 0, sizeof(blk->usig));
+		for (i = 0; i < blk->n; i++) {
+			s = &sl->stations[blk->ids[i]];
+			sig_add(blk->sig, field_ptr(sl, s->key), s->key.len);
+			sig_add(blk->usig, field_ptr(sl, s->url), s->url.len);
+		}
+		blk->sig_ok = true;
+	}
+	return blk->sig;
+}
+
+/* whether the signatures of blk leave room for a match of fq */
+bool
+block_fits(const struct station_list *sl, struct block *blk,
+    const struct query *fq)
+{
+	return sig_has(block_sig(sl, blk), fq->sig)
+	    && sig_has(blk->usig, fq->usig);
+}
+
+/* make the signatures of up to n more blocks ahead of the first scan */
+void
+sig_step(struct station_list *sl, size_t n)
+{
+	for (; n > 0 && sl->sig_next < sl->nblocks; n--, sl->sig_next++) {
+		block_sig(sl, sl->blocks[sl->sig_next]);
+	}
+}
+
+/* trigram at p in a search key, never 0 */
+uint32_t
+tri_key(const char *p)
+{
+	return 1u << 24 | (uint32_t)(unsigned char)p[0] << 16
+	    | (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+/* host of url u without scheme, user or port, its length put in len */
+const char *
+url_host(const char *u, size_t ulen, size_t *len)
+{
+	const char *p = u, *e, *a, *end = u + ulen;
+
+	for (e = p; e < end && (isalnum((unsigned char)*e) || *e == '+'
+	    || *e == '-' || *e == '.'); e++)
+		;
+	if (end - e >= 3 && memcmp(e, "://", 3) == 0) {
+		p = e + 3;
+	}
+	for (e = p; e < end && *e != '/' && *e != '?' && *e != '#'; e++)
+		;
+	for (a = e; a > p && a[-1] != '@'; a--)
+		;
+	p = a > p ? a : p;
+	for (a = e; a > p && isdigit((unsigned char)a[-1]); a--)
+		;
+	if (a > p && a[-1] == ':') {
+		e = a - 1;
+	}
+	*len = e - p;
+	return p;
+}
+
+/* index key of a host, folded for ASCII, apart from any trigram's */
+uint32_t
+host_key(const char *h, size_t len)
+{
+	uint32_t k = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		k = (k ^ FOLD(h[i])) * 16777619u;
+	}
+	return 1u << 31 | k;
+}
+
+/* posting list of key, created empty if add is set */
+struct posting *
+tri_get(struct station_list *sl, uint32_t key, bool add)
+{
+	struct posting *tab, *p;
+	size_t i, sz;
+
+	if (add && (sl->tri_n + 1) * 2 > sl->tri_sz) {
+		sz = sl->tri_sz ? sl->tri_sz * 2 : 4096;
+		tab = calloc(sz, sizeof(struct posting));
+		if (!tab) {
+			return NULL;
+		}
+		for (i = 0; i < sl->tri_sz; i++) {
+			if (!sl->tri[i].key) {
+				continue;
+			}
+			p = &tab[(sl->tri[i].key * 2654435761u) & (sz - 1)];
+			while (p->key) {
+				p = p == &tab[sz - 1] ? tab : p + 1;
+			}
+			*p = sl->tri[i];
+		}
+		free(sl->tri);
+		sl->tri = tab;
+		sl->tri_sz = sz;
+	}
+	if (sl->tri_sz == 0) {
+		return NULL;
+	}
+	i = (key * 2654435761u) & (sl->tri_sz - 1);
+	for (; sl->tri[i].key; i = (i + 1) & (sl->tri_sz - 1)) {
+		if (sl->tri[i].key == key) {
+			return &sl->tri[i];
+		}
+	}
+	if (!add) {
+		return NULL;
+	}
+	sl->tri[i].key = key;
+	sl->tri_n++;
+	return &sl->tri[i];
+}
+
+/* first index in p->ids not below id */
+size_t
+posting_find(const struct posting *p, size_t id)
+{
+	size_t lo = 0, hi = p->n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (p->ids[mid] < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* put id in the posting list of key */
+int
+posting_add(struct station_list *sl, uint32_t key, size_t id)
+{
+	struct posting *p = tri_get(sl, key, true);
+	void *a_tmp;
+	size_t k;
+
+	if (!p) {
+		return -1;
+	}
+	/* ids mostly arrive in order, check the tail first */
+	k = p->n && p->ids[p->n - 1] < id ? p->n : posting_find(p, id);
+	if (k < p->n && p->ids[k] == id) {
+		return 0;
+	}
+	if (p->n == p->a) {
+		a_tmp = realloc(p->ids, sizeof(uint32_t)
+		    * (p->a ? p->a * 2 : 4));
+		if (!a_tmp) {
+			return -1;
+		}
+		p->ids = a_tmp;
+		p->a = p->a ? p->a * 2 : 4;
+	}
+	memmove(p->ids + k + 1, p->ids + k, sizeof(uint32_t) * (p->n - k));
+	p->ids[k] = id;
+	p->n++;
+	return 0;
+}
+
+/* take id out of the posting list of key */
+void
+posting_remove(struct station_list *sl, uint32_t key, size_t id)
+{
+	struct posting *p = tri_get(sl, key, false);
+	size_t k;
+
+	if (!p) {
+		return;
+	}
+	k = posting_find(p, id);
+	if (k < p->n && p->ids[k] == id) {
+		memmove(p->ids + k, p->ids + k + 1,
+		    sizeof(uint32_t) * (p->n - k - 1));
+		p->n--;
+	}
+}
+
+/* add the trigrams of the search key of id, and its host, to the index */
+int
+index_add(struct station_list *sl, size_t id)
+{
+	const struct station *s = &sl->stations[id];
+	const char *name = field_ptr(sl, s->key), *h;
+	size_t i, len;
+
+	for (i = 0; i + 3 <= s->key.len; i++) {
+		if (posting_add(sl, tri_key(name + i), id) < 0) {
+			return -1;
+		}
+	}
+	h = url_host(field_ptr(sl, s->url), s->url.len, &len);
+	return len > 0 ? posting_add(sl, host_key(h, len), id) : 0;
+}
+
+/* drop id from the posting lists of its trigrams and its host */
+void
+index_remove(struct station_list *sl, size_t id)
+{
+	const struct station *s = &sl->stations[id];
+	const char *name = field_ptr(sl, s->key), *h;
+	size_t i, len;
+
+	for (i = 0; i + 3 <= s->key.len; i++) {
+		posting_remove(sl, tri_key(name + i), id);
+	}
+	h = url_host(field_ptr(sl, s->url), s->url.len, &len);
+	if (len > 0) {
+		posting_remove(sl, host_key(h, len), id);
+	}
+}
+
+/* index up to n more ids; edits keep the ids already indexed current */
+void
+index_step(struct station_list *sl, size_t n)
+{
+	if (sl->tri_off) {
+		return;
+	}
+	for (; n > 0 && sl->tri_next < sl->nrec; n--, sl->tri_next++) {
+		if (sl->owner[sl->tri_next]
+		    && index_add(sl, sl->tri_next) < 0) {
+			index_drop(sl);
+			return;
+		}
+	}
+}
+
+/* forget the index, the next index_step starts it over */
+void
+index_clear(struct station_list *sl)
+{
+	size_t i;
+
+	for (i = 0; i < sl->tri_sz; i++) {
+		free(sl->tri[i].ids);
+	}
+	free(sl->tri);
+	sl->tri = NULL;
+	sl->tri_sz = 0;
+	sl->tri_n = 0;
+	sl->tri_next = 0;
+}
+
+/* give up on the index, out of memory; index_step no longer builds it */
+void
+index_drop(struct station_list *sl)
+{
+	index_clear(sl);
+	sl->tri_off = true;
+}
+
+/*
+ * ids of the live stations whose key holds the folded query q, ascending,
+ * in *out; -1 if the index cannot answer because q is too short or it is
+ * incomplete, or should not because q is so common a scan meets a match
+ * sooner
+ */
+ssize_t
+index_query(struct station_list *sl, const char *q, uint32_t **out)
+{
+	struct posting **lists = NULL, *best = NULL;
+	struct field f;
+	size_t i, j, k, nt, n = 0;
+	ssize_t rv = -1;
+	uint32_t id;
+
+	*out = NULL;
+	nt = strlen(q);
+	if (nt < 3 || sl->tri_next < sl->nrec) {
+		return -1;
+	}
+	nt -= 2;
+	lists = malloc(sizeof(struct posting *) * nt);
+	if (!lists) {
+		return -1;
+	}
+	for (i = 0; i < nt; i++) {
+		lists[i] = tri_get(sl, tri_key(q + i), false);
+		if (!lists[i] || lists[i]->n == 0) {
+			rv = 0;
+			goto done;
+		}
+		if (!best || lists[i]->n < best->n) {
+			best = lists[i];
+		}
+	}
+	if (best->n > sl->size / INDEX_COMMON) {
+		goto done;
+	}
+	*out = malloc(sizeof(uint32_t) * best->n);
+	if (!*out) {
+		goto done;
+	}
+	for (j = 0; j < best->n; j++) {
+		id = best->ids[j];
+		for (i = 0; i < nt; i++) {
+			if (lists[i] == best) {
+				continue;
+			}
+			k = posting_find(lists[i], id);
+			if (k == lists[i]->n || lists[i]->ids[k] != id) {
+				break;
+			}
+		}
+		if (i < nt || !sl->owner[id]) {
+			continue;
+		}
+		/* the trigrams may be present without being adjacent */
+		f = sl->stations[id].key;
+		if (key_find(field_ptr(sl, f), f.len, q)) {
+			(*out)[n++] = id;
+		}
+	}
+	rv = n;
+done:
+	free(lists);
+	return rv;
+}
+
+/*
+ * ids of the stations that may be on host h, ascending, or -1 while
+ * the index is incomplete; a match of its key is left to be checked
+ */
+ssize_t
+host_query(struct station_list *sl, const char *h, uint32_t **out)
+{
+	struct posting *p;
+	size_t i, n = 0;
+
+	*out = NULL;
+	if (sl->tri_next < sl->nrec) {
+		return -1;
+	}
+	p = tri_get(sl, host_key(h, strlen(h)), false);
+	if (!p || p->n == 0) {
+		return 0;
+	}
+	*out = malloc(sizeof(uint32_t) * p->n);
+	if (!*out) {
+		return -1;
+	}
+	for (i = 0; i < p->n; i++) {
+		if (sl->owner[p->ids[i]]) {
+			(*out)[n++] = p->ids[i];
+		}
+	}
+	return n;
+}
+
+/* path with ext appended, or NULL */
+char *
+path_ext(const char *path, const char *ext)
+{
+	size_t len = strlen(path) + strlen(ext) + 1;
+	char *p;
+
+	p = malloc(len);
+	if (p) {
+		snprintf(p, len, "%s%s", path, ext);
+	}
+	return p;
+}
+
+/* make a rename in the directory holding path durable */
+int
+dir_sync(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	char dir[4096];
+	int fd, rv;
+
+	if (!slash) {
+		strcpy_t(dir, ".", sizeof(dir));
+	} else {
+		snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path + 1),
+		    path);
+	}
+	fd = open(dir, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	rv = fsync(fd);
+	close(fd);
+	return rv;
+}
+
+double
+elapsed_ms(const struct timespec *t0)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) * 1e3
+	    + (t.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/*
+ * wake the ui to look at the list again, from any thread or from mpv;
+ * with the pipe full it is awake already
+ */
+void
+list_wake(void *arg)
+{
+	struct station_list *sl = arg;
+
+	while (write(sl->wake[1], "", 1) < 0 && errno == EINTR)
+		;
+}
+
+int
+station_list_init(struct station_list *sl, char *path)
+{
+	sl->pg_i = 0;
+	sl->index = 0;
+	sl->size = 0;
+	sl->state = NORMAL;
+	sl->stations = malloc(sizeof(struct station) * 1024);
+	sl->free_ids = malloc(sizeof(size_t) * 1024);
+	sl->owner = malloc(sizeof(struct block *) * 1024);
+	sl->a_size = 1024;
+	sl->nrec = 0;
+	sl->nfree = 0;
+	sl->blocks = NULL;
+	sl->nblocks = 0;
+	sl->a_blocks = 0;
+	sl->fen = NULL;
+	sl->tri = NULL;
+	sl->tri_sz = 0;
+	sl->tri_n = 0;
+	sl->tri_next = 0;
+	sl->tri_off = false;
+	sl->sig_next = 0;
+	sl->nar.nlv = 0;
+	sl->nar.whole = false;
+	sl->nar.base = 0;
+	sl->nar.ids = NULL;
+	sl->nar.len = 0;
+	sl->nar.a_len = 0;
+	sl->nar.gen = 0;
+	sl->nar.size = 0;
+	sl->nar.from = 0;
+	sl->nar.from_pg = 0;
+	sl->filt.on = false;
+	sl->filt.regex = false;
+	sl->filt.re = NULL;
+	sl->filt.ids = NULL;
+	sl->filt.n = 0;
+	sl->filt.a = 0;
+	sl->filt.next = 0;
+	sl->filt.gen = 0;
+	sl->filt.pg = 0;
+	sl->qc.n = 0;
+	sl->qc.ids = 0;
+	sl->qc.tick = 0;
+	sl->fz.q[0] = '\0';
+	sl->fz.hits = NULL;
+	sl->fz.n = 0;
+	sl->fz.a = 0;
+	sl->fz.matched = 0;
+	sl->fz.size = 0;
+	sl->fz.edit_gen = 0;
+	sl->fz.row = 0;
+	sl->fz.pg = 0;
+	sl->fz.workers.threads = NULL;
+	sl->fz.workers.nthreads = 0;
+	sl->fz.workers.quit = false;
+	sl->fz.workers.parts = NULL;
+	sl->fz.workers.n = 0;
+	sl->fz.workers.next = 0;
+	sl->fz.workers.finished = 0;
+	pthread_mutex_init(&sl->fz.workers.lock, NULL);
+	pthread_cond_init(&sl->fz.workers.go, NULL);
+	pthread_cond_init(&sl->fz.workers.done, NULL);
+	sl->srch.started = false;
+	sl->srch.quit = false;
+	sl->srch.seq = 0;
+	sl->srch.done = 0;
+	sl->srch.seen = 0;
+	sl->srch.failed = false;
+	sl->srch.busy = false;
+	sl->srch.job = JOB_NONE;
+	sl->srch.then = THEN_NONE;
+	sl->srch.q[0] = '\0';
+	sl->srch.gen = 0;
+	sl->srch.size = 0;
+	sl->srch.pos = 0;
+	sl->srch.total = 0;
+	sl->srch.want = 0;
+	sl->scr.w = 0;
+	sl->scr.h = 0;
+	sl->scr.ok = false;
+	sl->scr.gen = 0;
+	sl->scr.rows = NULL;
+	sl->scr.bar = NULL;
+	pthread_cond_init(&sl->srch.wake, NULL);
+	pthread_mutex_init(&sl->srch.lock, NULL);
+	pthread_cond_init(&sl->srch.turn, NULL);
+	sl->pool.buf = NULL;
+	sl->pool.len = 0;
+	sl->pool.sz = 0;
+	sl->pool.refs = NULL;
+	sl->map = NULL;
+	sl->map_sz = 0;
+	sl->mapped = false;
+	sl->path = path;
+	sl->sel = NULL;
+	sl->loading = false;
+	sl->load_pos = 0;
+	sl->err[0] = '\0';
+	sl->gen = 0;
+	sl->edit_gen = 0;
+	sl->saved_gen = 0;
+	sl->jfd = -1;
+	sl->jlen = 0;
+	sl->jmark = 0;
+	sl->snap = NULL;
+	sl->compact_done = false;
+	clock_gettime(CLOCK_MONOTONIC, &sl->saved_at);
+	sl->save_fails = 0;
+	sl->wake[0] = -1;
+	sl->wake[1] = -1;
+	pthread_mutex_init(&sl->lock, NULL);
+	if (!sl->stations || !sl->free_ids || !sl->owner) {
+		printf("Failed to allocate stations list\n");
+		return -1;
+	}
+	if (pipe(sl->wake) < 0 || fcntl(sl->wake[0], F_SETFL, O_NONBLOCK) < 0
+	    || fcntl(sl->wake[1], F_SETFL, O_NONBLOCK) < 0) {
+		printf("Failed to create wake pipe\n");
+		return -1;
+	}
+	return 0;
+}
+
+int
+station_list_reserve(struct station_list *sl, size_t n)
+{
+	void *a_tmp;
+
+	if (n < sl->a_size) {
+		return 0;
+	}
+	n = MAX(n + 1, sl->a_size * 2);
+	a_tmp = realloc(sl->stations, sizeof(struct station) * n);
+	if (!a_tmp) {
+		return -1;
+	}
+	sl->stations = a_tmp;
+	/* room for every record, so deleting never has to allocate */
+	a_tmp = realloc(sl->free_ids, sizeof(size_t) * n);
+	if (!a_tmp) {
+		return -1;
+	}
+	sl->free_ids = a_tmp;
+	a_tmp = realloc(sl->owner, sizeof(struct block *) * n);
+	if (!a_tmp) {
+		return -1;
+	}
+	sl->owner = a_tmp;
+	sl->a_size = n;
+	return 0;
+}
+
+/*
+ * append a station, reusing the record of a deleted one if possible; its
+ * search key is made from the name unless given
+ */
+int
+station_list_add(struct station_list *sl, struct field name, struct field url,
+    const struct field *key)
+{
+	struct field k;
+	size_t id;
+	unsigned m;
+
+	if (key) {
+		k = *key;
+	} else if (key_make(&sl->pool, sl->map, name, &k) < 0) {
+		return -1;
+	}
+
+	if (sl->nfree > 0) {
+		id = sl->free_ids[sl->nfree - 1];
+	} else {
+		if (station_list_reserve(sl, sl->nrec + 1) < 0) {
+			printf("Failed to resize station list\n");
+			return -1;
+		}
+		id = sl->nrec;
+	}
+	if (seq_insert(sl, sl->size, id) < 0) {
+		printf("Failed to resize station list\n");
+		return -1;
+	}
+	if (id == sl->nrec) {
+		sl->nrec++;
+	} else {
+		sl->nfree--;
+	}
+	sl->stations[id].name = name;
+	sl->stations[id].url = url;
+	sl->stations[id].key = k;
+	/* an append keeps a signature already made whole */
+	if (sl->owner[id]->sig_ok) {
+		sig_add(sl->owner[id]->sig, field_ptr(sl, k), k.len);
+		sig_add(sl->owner[id]->usig, field_ptr(sl, url), url.len);
+	}
+	if (id < sl->tri_next && index_add(sl, id) < 0) {
+		index_drop(sl);
+	}
+	m = qcache_hits(sl, id);
+	sl->gen++;
+	qcache_sync(sl, m, sl->gen - 1);
+	return 0;
+}
+
+int
+station_list_swap(struct station_list *sl, size_t oi, size_t ni)
+{
+	struct block *ba, *bb;
+	size_t *a, *b, tmp;
+	unsigned m;
+
+	if (oi >= sl->size || ni >= sl->size) {
+		return -1;
+	}
+	a = seq_ref(sl, oi);
+	b = seq_ref(sl, ni);
+	/* matches holding either one are out of order */
+	m = qcache_hits(sl, *a) | qcache_hits(sl, *b);
+	ba = sl->owner[*a];
+	bb = sl->owner[*b];
+	tmp = *a;
+	*a = *b;
+	*b = tmp;
+	sl->owner[*a] = ba;
+	sl->owner[*b] = bb;
+	if (ba != bb) {
+		ba->sig_ok = false;
+		bb->sig_ok = false;
+	}
+	free(sl->sel);
+	sl->sel = NULL;
+	sl->gen++;
+	sl->edit_gen = sl->gen;
+	qcache_sync(sl, m, sl->gen - 1);
+	return 0;
+}
+
+int
+station_list_delete(struct station_list *sl, size_t index)
+{
+	size_t id;
+	unsigned m;
+
+	if (index >= sl->size) {
+		return -1;
+	}
+	id = *seq_ref(sl, index);
+	if (id < sl->tri_next) {
+		index_remove(sl, id);
+	}
+	m = qcache_hits(sl, id);
+	filter_drop(sl, index, id);
+	sl->free_ids[sl->nfree++] = seq_delete(sl, index);
+	if (sl->index == sl->size && sl->index > 0) {
+		sl->index -= 1;
+	}
+	/* the selection follows its station, or goes with it */
+	if (sl->sel && *sl->sel == index) {
+		free(sl->sel);
+		sl->sel = NULL;
+	} else if (sl->sel && *sl->sel > index) {
+		*sl->sel -= 1;
+	}
+	sl->gen++;
+	sl->edit_gen = sl->gen;
+	/* the filtered view lost the station with it and stays whole */
+	if (sl->filt.gen == sl->gen - 1) {
+		sl->filt.gen = sl->gen;
+		filter_snap(sl);
+	}
+	qcache_sync(sl, m, sl->gen - 1);
+	return 0;
+}
+
+/* replace the name, or the url, of the station at pos */
+int
+station_list_edit(struct station_list *sl, size_t pos, bool url,
+    const char *s, size_t len)
+{
+	size_t id;
+	bool idx;
+	unsigned m;
+	int rv = -1;
+
+	if (pos >= sl->size) {
+		return -1;
+	}
+	id = *seq_ref(sl, pos);
+	/* matches it leaves or joins */
+	m = qcache_hits(sl, id);
+	idx = id < sl->tri_next;
+	if (idx) {
+		index_remove(sl, id);
+	}
+	if (pool_add(&sl->pool, s, len, url ? &sl->stations[id].url
+	    : &sl->stations[id].name) < 0) {
+		goto done;
+	}
+	sl->owner[id]->sig_ok = false;
+	if (!url && key_make(&sl->pool, sl->map, sl->stations[id].name,
+	    &sl->stations[id].key) < 0) {
+		sl->stations[id].key = sl->stations[id].name;
+		goto done;
+	}
+	rv = 0;
+done:
+	/* taken out of the index above, whether or not the edit took */
+	if (idx && index_add(sl, id) < 0) {
+		index_drop(sl);
+	}
+	m |= qcache_hits(sl, id);
+	sl->gen++;
+	sl->edit_gen = sl->gen;
+	qcache_sync(sl, m, sl->gen - 1);
+	return rv;
+}
+
+/* drop strings orphaned by edits and deletes, keeping list order */
+int
+station_list_compact(struct station_list *sl)
+{
+	struct station *s;
+	struct field *f[3];
+	size_t i, j, n, len = 0;
+	bool shared;
+	char *pool;
+
+	for (i = 0; i < sl->size; i++) {
+		s = station_at(sl, i);
+		n = s->key.off == s->name.off ? 2 : 3;
+		f[0] = &s->name;
+		f[1] = &s->url;
+		f[2] = &s->key;
+		for (j = 0; j < n; j++) {
+			if (!(f[j]->off & F_MAP)) {
+				len += f[j]->len + 1;
+			}
+		}
+	}
+	if (len == sl->pool.len) {
+		return 0;
+	}
+	pool = malloc(len ? len : 1);
+	if (!pool) {
+		return -1;
+	}
+	len = 0;
+	for (i = 0; i < sl->size; i++) {
+		s = station_at(sl, i);
+		shared = s->key.off == s->name.off;
+		n = shared ? 2 : 3;
+		f[0] = &s->name;
+		f[1] = &s->url;
+		f[2] = &s->key;
+		for (j = 0; j < n; j++) {
+			if (!(f[j]->off & F_MAP)) {
+				memcpy(pool + len, sl->pool.buf + f[j]->off,
+				    f[j]->len + 1);
+				f[j]->off = len;
+				len += f[j]->len + 1;
+			}
+		}
+		if (shared) {
+			s->key = s->name;
+		}
+	}
+	pool_release(sl->pool.buf, sl->pool.refs);
+	sl->pool.buf = pool;
+	sl->pool.len = len;
+	sl->pool.sz = len ? len : 1;
+	sl->pool.refs = NULL;
+	return 0;
+}
+
+/* write the list out synchronously, for when there is no journal */
+int
+station_list_save(struct station_list *sl)
+{
+	struct snapshot *ss;
+	struct timespec t0;
+	char *bpath;
+	int rv = -1;
+
+	if (sl->gen == sl->saved_gen) {
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	station_list_compact(sl);
+	ss = snapshot_take(sl);
+	bpath = path_ext(sl->path, ".bak");
+	if (!ss || !bpath) {
+		goto done;
+	}
+	snapshot_write(ss);
+	if (ss->rv == 0) {
+		if (rename(bpath, sl->path) != 0 || dir_sync(sl->path) != 0) {
+			printf("Failed to replace stations file %s\n",
+			    sl->path);
+		} else {
+			sl->saved_gen = ss->gen;
+			printf("Saved %zu stations in %.1f ms\n", ss->size,
+			    elapsed_ms(&t0));
+			rv = 0;
+		}
+	}
+done:
+	free(bpath);
+	snapshot_free(ss);
+	return rv;
+}
+
+/* forget every station, keeping allocations of the record arrays */
+void
+station_list_clear(struct station_list *sl)
+{
+	size_t i;
+
+	for (i = 0; i < sl->nblocks; i++) {
+		free(sl->blocks[i]);
+	}
+	sl->nblocks = 0;
+	sl->sig_next = 0;
+	sl->size = 0;
+	sl->nrec = 0;
+	sl->nfree = 0;
+	sl->nar.nlv = 0;
+	sl->nar.base = 0;
+	sl->nar.len = 0;
+	sl->filt.n = 0;
+	sl->filt.next = 0;
+	sl->fz.n = 0;
+	sl->fz.q[0] = '\0';
+	while (sl->qc.n > 0) {
+		qcache_drop(sl, 0);
+	}
+	index_clear(sl);
+	sl->tri_off = false;
+}
+
+void
+station_list_free(struct station_list *sl)
+{
+	int i;
+
+	station_list_clear(sl);
+	free(sl->blocks);
+	sl->blocks = NULL;
+	free(sl->fen);
+	sl->fen = NULL;
+	free(sl->free_ids);
+	sl->free_ids = NULL;
+	free(sl->owner);
+	sl->owner = NULL;
+	free(sl->nar.ids);
+	sl->nar.ids = NULL;
+	free(sl->filt.ids);
+	sl->filt.ids = NULL;
+	regex_free(sl->filt.re);
+	sl->filt.re = NULL;
+	free(sl->fz.hits);
+	sl->fz.hits = NULL;
+	rank_stop(&sl->fz.workers);
+	free(sl->scr.rows);
+	sl->scr.rows = NULL;
+	free(sl->scr.bar);
+	sl->scr.bar = NULL;
+	free(sl->stations);
+	sl->stations = NULL;
+	pool_release(sl->pool.buf, sl->pool.refs);
+	sl->pool.buf = NULL;
+	sl->pool.refs = NULL;
+	if (sl->mapped) {
+		munmap(sl->map, sl->map_sz);
+	} else {
+		free(sl->map);
+	}
+	sl->map = NULL;
+	free(sl->sel);
+	sl->sel = NULL;
+	sl->size = 0;
+	for (i = 0; i < 2; i++) {
+		if (sl->wake[i] >= 0) {
+			close(sl->wake[i]);
+			sl->wake[i] = -1;
+		}
+	}
+}
+
+int
+player_init(struct player *pl, struct station_list *sl)
+{
+	pl->vol = 100;
+	pl->muted = 0;
+	pl->paused = 0;
+	pl->cur_station[0] = '\0';
+	pl->cmd[0] = '\0';
+	pl->msg[0] = '\0';
+	pl->title[0] = '\0';
+	pl->ctx = mpv_create();
+	if (!pl->ctx) {
+		printf("Failed to create mpv context\n");
+		return -1;
+	}
+	if (mpv_initialize(pl->ctx) < 0) {
+		printf("Failed to initialize MPV\n");
+		return -1;
+	}
+	/* events, the title changing among them, wake the ui */
+	mpv_set_wakeup_callback(pl->ctx, list_wake, sl);
+	if (mpv_observe_property(pl->ctx, 0, "media-title",
+	    MPV_FORMAT_NONE) < 0) {
+		printf("Failed to observe the media title\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* take the events mpv has queued, true if there were any */
+bool
+player_events(struct player *pl)
+{
+	mpv_event *ev;
+	char *title = NULL;
+	bool any = false, changed = false;
+
+	while ((ev = mpv_wait_event(pl->ctx, 0))->event_id != MPV_EVENT_NONE) {
+		any = true;
+		changed |= ev->event_id == MPV_EVENT_PROPERTY_CHANGE;
+	}
+	if (changed) {
+		mpv_get_property(pl->ctx, "media-title", MPV_FORMAT_OSD_STRING,
+		    &title);
+		strcpy_t(pl->title, title ? title : "", sizeof(pl->title));
+		mpv_free(title);
+	}
+	return any;
+}
+
+int
+vol_add(struct player *pl)
+{
+	if (pl->vol < 100) {
+		if (mpv_command_string(pl->ctx, "add volume 1") < 0) {
+			strcpy_t(pl->msg, "mpv api error", sizeof(pl->msg));
+			return -1;
+		}
+		pl->msg[0] = '\0';
+		pl->vol += 1;
+	}
+	return 0;
+}
+
+int
+vol_mute(struct player *pl)
+{
+	if (mpv_command_string(pl->ctx, "cycle mute") >= 0) {
+		pl->muted = 1 - pl->muted;
+		return 0;
+	}
+	return -1;
+}
+
+int
+vol_sub(struct player *pl)
+{
+	if (pl->vol > 0) {
+		if (mpv_command_string(pl->ctx, "add volume -1") < 0) {
+			strcpy_t(pl->msg, "mpv api error", sizeof(pl->msg));
+			return -1;
+		}
+		pl->msg[0] = '\0';
+		pl->vol -= 1;
+	}
+	return 0;
+}
+
+int
+stop(struct player *pl)
+{
+	if (mpv_command_string(pl->ctx, "cycle pause") < 0) {
+		strcpy_t(pl->msg, "mpv api error", sizeof(pl->msg));
+		return -1;
+	}
+	pl->paused = 1 - pl->paused;
+	return 0;
+}
+
+int
+play(struct player *pl, const struct station_list *sl,
+    const struct station *s)
+{
+	const char *cmd[] = {"loadfile", NULL, NULL};
+	char *url;
+
+	url = malloc(s->url.len + 1);
+	if (!url) {
+		strcpy_t(pl->msg, "Allocation failed", sizeof(pl->msg));
+		return -1;
+	}
+	field_copy(sl, s->url, url, s->url.len + 1);
+	cmd[1] = url;
+	if (mpv_command(pl->ctx, cmd) < 0) {
+		strcpy_t(pl->msg, "Failed to play URL", sizeof(pl->msg));
+		free(url);
+		return -1;
+	}
+	free(url);
+	pl->msg[0] = '\0';
+	field_copy(sl, s->name, pl->cur_station, sizeof(pl->cur_station));
+	return 0;
+}
+
+int
+map_stations(struct station_list *sl, FILE *stream)
+{
+	struct stat st;
+	size_t len;
+	long pos;
+	void *map;
+
+	if (fstat(fileno(stream), &st) == 0 && S_ISREG(st.st_mode)) {
+		if (st.st_size == 0) {
+			return 0;
+		}
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+		    fileno(stream), 0);
+		if (map != MAP_FAILED) {
+			posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+			sl->map = map;
+			sl->map_sz = st.st_size;
+			sl->mapped = true;
+			return 0;
+		}
+	}
+
+	/* not mappable, fall back to reading a private copy */
+	if (fseek(stream, 0L, SEEK_END) != 0) {
+		return -1;
+	}
+	pos = ftell(stream);
+	if (pos == -1) {
+		return -1;
+	}
+	if (fseek(stream, 0L, SEEK_SET) != 0) {
+		return -1;
+	}
+	sl->map = malloc(sizeof(char) * (pos + 1));
+	if (!sl->map) {
+		return -1;
+	}
+	len = fread(sl->map, sizeof(char), pos, stream);
+	if (ferror(stream) != 0) {
+		return -1;
+	}
+	sl->map_sz = len;
+	return 0;
+}
+
+/*
+ * copy a quoted field containing escapes into the pool, returning the
+ * byte that ended it (closing quote, newline or end of input)
+ */
+const char *
+unescape(struct pool *pool, const char *p, const char *end, struct field *f)
+{
+	const char *q, *nl;
+	bool esc = false;
+
+	nl = memchr(p, '\n', end - p);
+	if (!nl) {
+		nl = end;
+	}
+	if (pool_reserve(pool, nl - p + 1) < 0) {
+		return NULL;
+	}
+	f->off = pool->len;
+	for (;; p = q + 1) {
+		q = scan_field(p, nl);
+		memcpy(pool->buf + pool->len, p, q - p);
+		pool->len += q - p;
+		if (q == nl) {
+			p = nl;
+			break;
+		} else if (*q == '\\') {
+			esc = true;
+		} else if (!esc) {
+			p = q;
+			break;
+		} else {
+			esc = false;
+			pool->buf[pool->len++] = '\"';
+		}
+	}
+	f->len = pool->len - f->off;
+	pool->buf[pool->len++] = '\0';
+	return p;
+}
+
+/*
+ * parse the fields of one chunk, stopping at the first error; escaped
+ * fields go to the chunk's own pool so chunks can run in parallel
+ */
+void *
+parse_chunk(void *arg)
+{
+	struct chunk *c = arg;
+	struct field f;
+	const char *p = c->p, *q;
+	void *a_tmp;
+
+	while (p < c->end) {
+		if (*p == '\n') {
+			c->lines++;
+			p++;
+			continue;
+		} else if (*p == ' ') {
+			p++;
+			continue;
+		} else if (*p != '\"') {
+			c->err = "Missing quote";
+			return NULL;
+		}
+		q = scan_field(++p, c->end);
+		if (q < c->end && *q == '\\') {
+			q = unescape(&c->pool, p, c->end, &f);
+			if (!q) {
+				c->err = "Allocation failed";
+				return NULL;
+			}
+		} else {
+			f.off = (p - c->base) | F_MAP;
+			f.len = q - p;
+		}
+		if (q == c->end) {
+			/* unterminated field at end of input */
+			break;
+		} else if (*q == '\n') {
+			c->err = "Unexpected end of line";
+			return NULL;
+		}
+		p = q + 1;
+		if (c->n == c->a_size) {
+			a_tmp = realloc(c->fields, sizeof(struct field)
+			    * (c->a_size ? c->a_size * 2 : 1024));
+			if (!a_tmp) {
+				c->err = "Allocation failed";
+				return NULL;
+			}
+			c->fields = a_tmp;
+			c->a_size = c->a_size ? c->a_size * 2 : 1024;
+		}
+		c->fields[c->n++] = f;
+	}
+	return NULL;
+}
+
+void *
+parse_worker(void *arg)
+{
+	struct parse *ps = arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&ps->lock);
+		i = ps->next++;
+		pthread_mutex_unlock(&ps->lock);
+		if (i >= ps->n) {
+			return NULL;
+		}
+		parse_chunk(&ps->chunks[i]);
+		pthread_mutex_lock(&ps->lock);
+		ps->chunks[i].done = true;
+		pthread_cond_broadcast(&ps->done);
+		pthread_mutex_unlock(&ps->lock);
+	}
+}
+
+/*
+ * the mapped file is split at line boundaries and the chunks parsed by
+ * a pool of threads; chunks are merged into the list in file order as
+ * they complete, so stations and errors come out the same as from a
+ * single pass and the list can be shown while the rest is parsed
+ */
+int
+parse_stations(struct station_list *sl)
+{
+	struct parse ps;
+	struct chunk *c;
+	struct field f, name = {0, 0};
+	pthread_t *workers = NULL;
+	size_t i, j, base, nworkers = 0, line = 1;
+	long ncpu;
+	const char *p, *end;
+	bool step = false;
+	int rv = -1;
+
+	ps.n = sl->map_sz <= PARSE_FIRST ? 1
+	    : 2 + (sl->map_sz - PARSE_FIRST) / PARSE_CHUNK;
+	ps.next = 0;
+	ps.chunks = calloc(ps.n, sizeof(struct chunk));
+	/* err is read by the ui under the lock */
+	if (!ps.chunks) {
+		list_lock(sl);
+		snprintf(sl->err, sizeof(sl->err), "Allocation failed");
+		pthread_mutex_unlock(&sl->lock);
+		return -1;
+	}
+	pthread_mutex_init(&ps.lock, NULL);
+	pthread_cond_init(&ps.done, NULL);
+	p = sl->map;
+	end = p + sl->map_sz;
+	for (i = 0; i < ps.n; i++) {
+		c = &ps.chunks[i];
+		c->base = sl->map;
+		c->p = p;
+		c->end = end;
+		if (i < ps.n - 1) {
+			p = MAX(p, sl->map + MIN(sl->map_sz,
+			    PARSE_FIRST + (i * (size_t)PARSE_CHUNK)));
+			p = memchr(p, '\n', end - p);
+			c->end = p ? p + 1 : end;
+		}
+		p = c->end;
+	}
+
+	/* this thread parses too, whenever the next chunk is unclaimed */
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu > 1 && ps.n > 1) {
+		ncpu = MIN((size_t)ncpu - 1, ps.n);
+		workers = calloc(ncpu, sizeof(pthread_t));
+	}
+	for (i = 0; workers && i < (size_t)ncpu; i++) {
+		if (pthread_create(&workers[i], NULL, parse_worker, &ps) != 0) {
+			break;
+		}
+		nworkers++;
+	}
+
+	for (i = 0; i < ps.n; i++) {
+		c = &ps.chunks[i];
+		pthread_mutex_lock(&ps.lock);
+		if (ps.next <= i) {
+			ps.next = i + 1;
+			pthread_mutex_unlock(&ps.lock);
+			parse_chunk(c);
+		} else {
+			while (!c->done) {
+				pthread_cond_wait(&ps.done, &ps.lock);
+			}
+			pthread_mutex_unlock(&ps.lock);
+		}
+		if (c->err) {
+			list_lock(sl);
+			snprintf(sl->err, sizeof(sl->err), "line %zu: %s",
+			    line + c->lines, c->err);
+			pthread_mutex_unlock(&sl->lock);
+			goto done;
+		}
+		line += c->lines;
+
+		list_lock(sl);
+		if (station_list_reserve(sl, sl->nrec + c->n / 2 + 1) < 0
+		    || pool_reserve(&sl->pool, c->pool.len) < 0) {
+			snprintf(sl->err, sizeof(sl->err), "Allocation failed");
+			pthread_mutex_unlock(&sl->lock);
+			goto done;
+		}
+		/* before the adds, which append the keys to the pool */
+		base = sl->pool.len;
+		if (c->pool.len > 0) {
+			memcpy(sl->pool.buf + base, c->pool.buf, c->pool.len);
+			sl->pool.len += c->pool.len;
+		}
+		for (j = 0; j < c->n; j++) {
+			f = c->fields[j];
+			if (!(f.off & F_MAP)) {
+				f.off += base;
+			}
+			if (step == false) {
+				name = f;
+				step = true;
+			} else {
+				station_list_add(sl, name, f, NULL);
+				step = false;
+			}
+		}
+		sl->load_pos = c->end - sl->map;
+		pthread_mutex_unlock(&sl->lock);
+		free(c->fields);
+		c->fields = NULL;
+		free(c->pool.buf);
+		c->pool.buf = NULL;
+	}
+	if (sl->mapped) {
+		posix_madvise(sl->map, sl->map_sz, POSIX_MADV_RANDOM);
+	}
+	rv = 0;
+done:
+	pthread_mutex_lock(&ps.lock);
+	ps.next = ps.n;
+	pthread_mutex_unlock(&ps.lock);
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+	for (i = 0; i < ps.n; i++) {
+		free(ps.chunks[i].fields);
+		free(ps.chunks[i].pool.buf);
+	}
+	free(ps.chunks);
+	pthread_mutex_destroy(&ps.lock);
+	pthread_cond_destroy(&ps.done);
+	return rv;
+}
+
+/* loader thread: parse the mapped file, then refresh the binary cache */
+void *
+load_stations(void *arg)
+{
+	struct station_list *sl = arg;
+	struct snapshot *ss;
+
+	if (parse_stations(sl) < 0) {
+		list_lock(sl);
+		sl->loading = false;
+		pthread_mutex_unlock(&sl->lock);
+		list_wake(sl);
+		return NULL;
+	}
+	list_lock(sl);
+	ss = snapshot_take(sl);
+	journal_open(sl);
+	sl->loading = false;
+	pthread_mutex_unlock(&sl->lock);
+	list_wake(sl);
+	if (ss) {
+		cache_write(ss, &sl->src, hash(HASH_INIT, sl->map, sl->map_sz));
+		/* the pool refs are shared with main */
+		list_lock(sl);
+		snapshot_free(ss);
+		pthread_mutex_unlock(&sl->lock);
+	}
+	return NULL;
+}
+
+/* load stations from the binary cache if it is still valid for stream */
+int
+cache_load(struct station_list *sl, FILE *stream)
+{
+	struct cache_hdr hdr;
+	struct cache_rec *rec;
+	struct field name, url, key;
+	struct stat st, cst;
+	FILE *cache = NULL;
+	size_t i;
+	uint64_t h;
+	void *map = MAP_FAILED, *src;
+	char *cpath = NULL;
+
+	if (fstat(fileno(stream), &st) != 0 || !S_ISREG(st.st_mode)) {
+		return -1;
+	}
+	cpath = path_ext(sl->path, ".cache");
+	if (!cpath) {
+		return -1;
+	}
+	cache = fopen(cpath, "r");
+	free(cpath);
+	if (!cache) {
+		return -1;
+	}
+	if (fstat(fileno(cache), &cst) != 0
+	    || (size_t)cst.st_size < sizeof(hdr)) {
+		goto error;
+	}
+	map = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fileno(cache),
+	    0);
+	if (map == MAP_FAILED) {
+		goto error;
+	}
+	memcpy(&hdr, map, sizeof(hdr));
+	if (memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic)) != 0
+	    || hdr.version != CACHE_VERSION || hdr.size != cst.st_size
+	    || hdr.src_size != st.st_size || hdr.src_ino != st.st_ino
+	    || hdr.src_sec != st.st_mtim.tv_sec
+	    || hdr.src_nsec != st.st_mtim.tv_nsec
+	    || hdr.count > (hdr.size - sizeof(hdr)) / sizeof(*rec)) {
+		goto error;
+	}
+	/* coarse timestamps can miss an edit, compare contents instead */
+	if (hdr.src_nsec == 0 && st.st_size > 0) {
+		src = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+		    fileno(stream), 0);
+		if (src == MAP_FAILED) {
+			goto error;
+		}
+		h = hash(HASH_INIT, src, st.st_size);
+		munmap(src, st.st_size);
+		if (h != hdr.src_hash) {
+			goto error;
+		}
+	}
+	rec = (struct cache_rec *)((char *)map + sizeof(hdr));
+	for (i = 0; i < hdr.count; i++) {
+		if (rec[i].name_off > hdr.size
+		    || rec[i].name_len > hdr.size - rec[i].name_off
+		    || rec[i].url_off > hdr.size
+		    || rec[i].url_len > hdr.size - rec[i].url_off
+		    || rec[i].key_off > hdr.size
+		    || rec[i].key_len > hdr.size - rec[i].key_off) {
+			goto error;
+		}
+	}
+	if (station_list_reserve(sl, hdr.count) < 0) {
+		goto error;
+	}
+	for (i = 0; i < hdr.count; i++) {
+		name.off = rec[i].name_off | F_MAP;
+		name.len = rec[i].name_len;
+		url.off = rec[i].url_off | F_MAP;
+		url.len = rec[i].url_len;
+		key.off = rec[i].key_off | F_MAP;
+		key.len = rec[i].key_len;
+		if (station_list_add(sl, name, url, &key) < 0) {
+			station_list_clear(sl);
+			goto error;
+		}
+	}
+	sl->map = map;
+	sl->map_sz = cst.st_size;
+	sl->mapped = true;
+	fclose(cache);
+	return 0;
+error:
+	if (map != MAP_FAILED) {
+		munmap(map, cst.st_size);
+	}
+	fclose(cache);
+	return -1;
+}
+
+/* write the binary cache for the current list, src describes its source */
+int
+cache_write(const struct snapshot *ss, const struct stat *src,
+    uint64_t src_hash)
+{
+	struct cache_hdr hdr;
+	struct cache_rec rec;
+	const struct station *s;
+	FILE *cache = NULL;
+	size_t i;
+	uint64_t off;
+	char *cpath = NULL, *tpath = NULL;
+
+	cpath = path_ext(ss->path, ".cache");
+	tpath = path_ext(ss->path, ".cache.tmp");
+	if (!cpath || !tpath) {
+		goto error;
+	}
+	cache = fopen(tpath, "w");
+	if (!cache) {
+		goto error;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = CACHE_VERSION;
+	hdr.src_size = src->st_size;
+	hdr.src_sec = src->st_mtim.tv_sec;
+	hdr.src_nsec = src->st_mtim.tv_nsec;
+	hdr.src_ino = src->st_ino;
+	hdr.src_hash = src_hash;
+	hdr.count = ss->size;
+	off = sizeof(hdr) + sizeof(rec) * ss->size;
+	for (i = 0; i < ss->size; i++) {
+		s = &ss->stations[i];
+		off += s->name.len + s->url.len;
+		if (s->key.off != s->name.off) {
+			off += s->key.len;
+		}
+	}
+	hdr.size = off;
+	fwrite(&hdr, sizeof(hdr), 1, cache);
+
+	off = sizeof(hdr) + sizeof(rec) * ss->size;
+	for (i = 0; i < ss->size; i++) {
+		s = &ss->stations[i];
+		rec.name_off = off;
+		rec.name_len = s->name.len;
+		off += s->name.len;
+		rec.url_off = off;
+		rec.url_len = s->url.len;
+		off += s->url.len;
+		/* a key equal to the name is not stored twice */
+		rec.key_off = rec.name_off;
+		rec.key_len = s->key.len;
+		if (s->key.off != s->name.off) {
+			rec.key_off = off;
+			off += s->key.len;
+		}
+		fwrite(&rec, sizeof(rec), 1, cache);
+	}
+	for (i = 0; i < ss->size; i++) {
+		s = &ss->stations[i];
+		fwrite(snap_ptr(ss, s->name), 1, s->name.len, cache);
+		fwrite(snap_ptr(ss, s->url), 1, s->url.len, cache);
+		if (s->key.off != s->name.off) {
+			fwrite(snap_ptr(ss, s->key), 1, s->key.len, cache);
+		}
+	}
+	if (fclose(cache) != 0) {
+		cache = NULL;
+		goto error;
+	}
+	cache = NULL;
+	if (rename(tpath, cpath) != 0) {
+		goto error;
+	}
+	free(cpath);
+	free(tpath);
+	return 0;
+error:
+	if (cache) {
+		fclose(cache);
+	}
+	if (tpath) {
+		unlink(tpath);
+	}
+	free(cpath);
+	free(tpath);
+	return -1;
+}
+
+/* compact the pool and copy the list order; main thread, list locked */
+struct snapshot *
+snapshot_take(struct station_list *sl)
+{
+	struct snapshot *ss;
+	struct block *blk;
+	size_t b, j, i = 0;
+
+	ss = calloc(1, sizeof(struct snapshot));
+	if (!ss) {
+		return NULL;
+	}
+	ss->stations = malloc(sizeof(struct station) * MAX(sl->size, 1));
+	if (!ss->stations) {
+		free(ss);
+		return NULL;
+	}
+	if (!sl->pool.refs) {
+		sl->pool.refs = malloc(sizeof(size_t));
+		if (!sl->pool.refs) {
+			free(ss->stations);
+			free(ss);
+			return NULL;
+		}
+		*sl->pool.refs = 1;
+	}
+	for (b = 0; b < sl->nblocks; b++) {
+		blk = sl->blocks[b];
+		for (j = 0; j < blk->n; j++) {
+			ss->stations[i++] = sl->stations[blk->ids[j]];
+		}
+	}
+	ss->pool = sl->pool.buf;
+	ss->refs = sl->pool.refs;
+	++*ss->refs;
+	ss->size = sl->size;
+	ss->map = sl->map;
+	ss->path = sl->path;
+	ss->gen = sl->gen;
+	ss->rv = -1;
+	return ss;
+}
+
+const char *
+snap_ptr(const struct snapshot *ss, struct field f)
+{
+	if (f.off & F_MAP) {
+		return ss->map + (f.off & ~F_MAP);
+	}
+	return ss->pool + f.off;
+}
+
+/*
+ * write the snapshot to <path>.bak in one write, flushed to disk, and
+ * refresh the cache for it
+ */
+void *
+snapshot_write(void *arg)
+{
+	struct snapshot *ss = arg;
+	struct station *s;
+	struct timespec t0;
+	size_t i, len = 0;
+	ssize_t n;
+	char *bpath, *buf = NULL, *p;
+	int fd = -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	bpath = path_ext(ss->path, ".bak");
+	if (!bpath) {
+		return NULL;
+	}
+	for (i = 0; i < ss->size; i++) {
+		len += ss->stations[i].name.len + ss->stations[i].url.len + 6;
+	}
+	buf = malloc(MAX(len, 1));
+	if (!buf) {
+		goto done;
+	}
+	for (i = 0, p = buf; i < ss->size; i++) {
+		s = &ss->stations[i];
+		*p++ = '"';
+		memcpy(p, snap_ptr(ss, s->name), s->name.len);
+		p += s->name.len;
+		memcpy(p, "\" \"", 3);
+		p += 3;
+		memcpy(p, snap_ptr(ss, s->url), s->url.len);
+		p += s->url.len;
+		memcpy(p, "\"\n", 2);
+		p += 2;
+	}
+	fd = open(bpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		goto done;
+	}
+	for (p = buf; p < buf + len; p += n) {
+		n = write(fd, p, buf + len - p);
+		if (n < 0) {
+			goto done;
+		}
+	}
+	if (fdatasync(fd) == 0 && fstat(fd, &ss->st) == 0) {
+		ss->rv = 0;
+	}
+done:
+	if (fd >= 0 && close(fd) != 0) {
+		ss->rv = -1;
+	}
+	if (ss->rv == 0) {
+		cache_write(ss, &ss->st, hash(HASH_INIT, buf, len));
+	} else {
+		unlink(bpath);
+	}
+	ss->ms = elapsed_ms(&t0);
+	free(buf);
+	free(bpath);
+	return NULL;
+}
+
+void
+snapshot_free(struct snapshot *ss)
+{
+	if (ss) {
+		free(ss->stations);
+		if (ss->refs) {
+			pool_release(ss->pool, ss->refs);
+		}
+		free(ss);
+	}
+}
+
+/* 0 if the journal on fd was started for the stations file st */
+int
+journal_check(int fd, const struct stat *st)
+{
+	struct journal_hdr hdr;
+
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+	    || memcmp(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic)) != 0
+	    || hdr.version != JOURNAL_VERSION
+	    || hdr.src_size != st->st_size || hdr.src_ino != st->st_ino
+	    || hdr.src_sec != st->st_mtim.tv_sec
+	    || hdr.src_nsec != st->st_mtim.tv_nsec) {
+		return -1;
+	}
+	return 0;
+}
+
+/* create a journal for the stations file st holding recs, open to append */
+int
+journal_new(const char *jpath, const struct stat *st, const char *recs,
+    size_t len)
+{
+	struct journal_hdr hdr;
+	int fd;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic));
+	hdr.version = JOURNAL_VERSION;
+	hdr.src_size = st->st_size;
+	hdr.src_ino = st->st_ino;
+	hdr.src_sec = st->st_mtim.tv_sec;
+	hdr.src_nsec = st->st_mtim.tv_nsec;
+	fd = open(jpath, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || (len > 0 && write(fd, recs, len) != (ssize_t)len)
+	    || fdatasync(fd) != 0) {
+		close(fd);
+		unlink(jpath);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * apply the records of the journal on fd to the list, up to the first
+ * torn or invalid one, and cut the journal there
+ */
+int
+journal_replay(struct station_list *sl, int fd)
+{
+	struct journal_rec rec;
+	struct field name, url;
+	struct stat st;
+	size_t off, pos;
+	uint64_t sum;
+	char *buf, *data;
+	int rv = 0;
+
+	if (journal_check(fd, &sl->src) < 0 || fstat(fd, &st) != 0) {
+		return -1;
+	}
+	buf = malloc(st.st_size);
+	if (!buf || pread(fd, buf, st.st_size, 0) != st.st_size) {
+		free(buf);
+		return -1;
+	}
+	for (off = sizeof(struct journal_hdr);
+	    off + sizeof(rec) <= (size_t)st.st_size;
+	    off += sizeof(rec) + rec.len) {
+		memcpy(&rec, buf + off, sizeof(rec));
+		if (rec.len > st.st_size - off - sizeof(rec)) {
+			break;
+		}
+		data = buf + off + sizeof(rec);
+		sum = rec.sum;
+		rec.sum = 0;
+		if (hash(hash(HASH_INIT, (char *)&rec, sizeof(rec)), data,
+		    rec.len) != sum) {
+			break;
+		}
+		rec.sum = sum;
+		pos = rec.a;
+		if (rec.op == J_ADD) {
+			if (rec.a + rec.b != rec.len
+			    || pool_add(&sl->pool, data, rec.a, &name) < 0
+			    || pool_add(&sl->pool, data + rec.a, rec.b,
+			    &url) < 0
+			    || station_list_add(sl, name, url, NULL) < 0) {
+				break;
+			}
+		} else if (rec.op == J_NAME || rec.op == J_URL) {
+			if (station_list_edit(sl, pos, rec.op == J_URL, data,
+			    rec.len) < 0) {
+				break;
+			}
+		} else if (rec.op == J_DEL && pos < sl->size) {
+			station_list_delete(sl, pos);
+		} else if (rec.op == J_SWAP && pos < sl->size
+		    && rec.b < sl->size) {
+			station_list_swap(sl, pos, rec.b);
+		} else {
+			break;
+		}
+	}
+	if (off != (size_t)st.st_size && ftruncate(fd, off) != 0) {
+		rv = -1;
+	}
+	sl->jlen = off;
+	free(buf);
+	return rv;
+}
+
+/* replay the journal for the loaded list and keep it open for edits */
+int
+journal_open(struct station_list *sl)
+{
+	char *jpath, *npath;
+	int fd;
+
+	/* the list as loaded is what the stations file holds */
+	sl->saved_gen = sl->gen;
+	jpath = path_ext(sl->path, ".journal");
+	npath = path_ext(sl->path, ".journal.new");
+	if (!jpath || !npath) {
+		free(jpath);
+		free(npath);
+		return -1;
+	}
+	/* a compaction stopped between replacing the list and its journal */
+	fd = open(npath, O_RDONLY);
+	if (fd >= 0) {
+		if (journal_check(fd, &sl->src) == 0) {
+			rename(npath, jpath);
+		} else {
+			unlink(npath);
+		}
+		close(fd);
+	}
+	fd = open(jpath, O_RDWR | O_APPEND);
+	if (fd >= 0 && journal_replay(sl, fd) < 0) {
+		close(fd);
+		fd = -1;
+	}
+	if (fd < 0) {
+		fd = journal_new(jpath, &sl->src, NULL, 0);
+		sl->jlen = sizeof(struct journal_hdr);
+		dir_sync(jpath);
+	}
+	sl->jfd = fd;
+	free(jpath);
+	free(npath);
+	return fd < 0 ? -1 : 0;
+}
+
+/* record an edit made through the ui; it is durable once this returns */
+int
+journal_append(struct station_list *sl, enum journal_op op, uint64_t a,
+    uint64_t b, const char *s1, size_t l1, const char *s2, size_t l2)
+{
+	struct journal_rec rec;
+	size_t len = sizeof(rec) + l1 + l2;
+	char *buf;
+
+	if (sl->jfd < 0) {
+		return -1;
+	}
+	buf = malloc(len);
+	if (!buf) {
+		return -1;
+	}
+	rec.op = op;
+	rec.len = l1 + l2;
+	rec.a = a;
+	rec.b = b;
+	rec.sum = 0;
+	memcpy(buf, &rec, sizeof(rec));
+	if (l1 > 0) {
+		memcpy(buf + sizeof(rec), s1, l1);
+	}
+	if (l2 > 0) {
+		memcpy(buf + sizeof(rec) + l1, s2, l2);
+	}
+	rec.sum = hash(HASH_INIT, buf, len);
+	memcpy(buf, &rec, sizeof(rec));
+	if (write(sl->jfd, buf, len) != (ssize_t)len
+	    || fdatasync(sl->jfd) != 0) {
+		if (ftruncate(sl->jfd, sl->jlen) != 0) {
+			close(sl->jfd);
+			sl->jfd = -1;
+		}
+		free(buf);
+		return -1;
+	}
+	free(buf);
+	sl->jlen += len;
+	return 0;
+}
+
+void *
+compact_run(void *arg)
+{
+	struct station_list *sl = arg;
+
+	snapshot_write(sl->snap);
+	list_lock(sl);
+	sl->compact_done = true;
+	pthread_mutex_unlock(&sl->lock);
+	list_wake(sl);
+	return NULL;
+}
+
+/*
+ * save the list and merge the journal into it on a compactor thread, the
+ * ui keeps editing the live list meanwhile
+ */
+int
+compact_start(struct station_list *sl)
+{
+	if (sl->snap) {
+		return 0;
+	}
+	sl->snap = snapshot_take(sl);
+	if (!sl->snap) {
+		sl->save_fails++;
+		clock_gettime(CLOCK_MONOTONIC, &sl->saved_at);
+		return -1;
+	}
+	sl->jmark = sl->jlen;
+	sl->compact_done = false;
+	if (pthread_create(&sl->compactor, NULL, compact_run, sl) != 0) {
+		/* the caller holds the lock compact_run would take */
+		snapshot_write(sl->snap);
+		return compact_finish(sl);
+	}
+	return 0;
+}
+
+/*
+ * once the snapshot is written: start a journal for it holding the edits
+ * made since, then replace the stations file and the journal
+ */
+int
+compact_finish(struct station_list *sl)
+{
+	struct snapshot *ss = sl->snap;
+	size_t len = sl->jlen - sl->jmark;
+	char *bpath, *jpath, *npath, *tail;
+	int fd = -1, rv = -1;
+
+	bpath = path_ext(sl->path, ".bak");
+	jpath = path_ext(sl->path, ".journal");
+	npath = path_ext(sl->path, ".journal.new");
+	tail = malloc(MAX(len, 1));
+	if (ss->rv < 0 || !bpath || !jpath || !npath || !tail) {
+		goto done;
+	}
+	if (sl->jfd >= 0) {
+		if (pread(sl->jfd, tail, len, sl->jmark) != (ssize_t)len) {
+			goto done;
+		}
+		fd = journal_new(npath, &ss->st, tail, len);
+		if (fd < 0) {
+			goto done;
+		}
+	}
+	if (rename(bpath, sl->path) != 0) {
+		if (fd >= 0) {
+			close(fd);
+			unlink(npath);
+		}
+		goto done;
+	}
+	/* from here on the new journal is the one to use */
+	if (fd >= 0) {
+		rename(npath, jpath);
+		close(sl->jfd);
+		sl->jfd = fd;
+		sl->jlen = sizeof(struct journal_hdr) + len;
+	}
+	dir_sync(sl->path);
+	sl->src = ss->st;
+	sl->saved_gen = ss->gen;
+	rv = 0;
+done:
+	if (rv < 0 && bpath) {
+		unlink(bpath);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &sl->saved_at);
+	sl->save_fails = rv < 0 ? sl->save_fails + 1 : 0;
+	free(bpath);
+	free(jpath);
+	free(npath);
+	free(tail);
+	snapshot_free(ss);
+	sl->snap = NULL;
+	sl->compact_done = false;
+	return rv;
+}
+
+/*
+ * ms until a changed list is due to be saved: at once for a long
+ * journal, and later and later while saves keep failing
+ */
+double
+save_wait(const struct station_list *sl)
+{
+	double ms = AUTOSAVE_SEC * 1e3;
+
+	if (sl->save_fails > 0) {
+		ms *= 1 << MIN(sl->save_fails, SAVE_BACKOFF);
+	} else if (sl->jlen > JOURNAL_MAX) {
+		return 0;
+	}
+	return ms - elapsed_ms(&sl->saved_at);
+}
+
+/* add an nfa state, or -1 once the pattern has grown too large */
+int
+re_node(struct regex *re, enum re_op op, int out, int out1, int set)
+{
+	void *a_tmp;
+	size_t k;
+
+	if (re->n >= RE_STATES) {
+		re->err = "Pattern too large";
+		return -1;
+	}
+	if (re->n == re->a) {
+		k = re->a ? re->a * 2 : 64;
+		a_tmp = realloc(re->node, sizeof(struct re_node) * k);
+		if (!a_tmp) {
+			re->err = "Allocation failed";
+			return -1;
+		}
+		re->node = a_tmp;
+		re->a = k;
+	}
+	re->node[re->n].op = op;
+	re->node[re->n].out = out;
+	re->node[re->n].out1 = out1;
+	re->node[re->n].set = set;
+	return re->n++;
+}
+
+/*
+ * a fragment is a start state *b and an end state *e, a RE_NOP whose out
+ * is left for whatever follows; this one consumes a byte in bits
+ */
+int
+re_byte(struct regex *re, const uint64_t *bits, int *b, int *e)
+{
+	void *a_tmp;
+	size_t k;
+
+	if (re->nset == re->aset) {
+		k = re->aset ? re->aset * 2 : 16;
+		a_tmp = realloc(re->set, sizeof(*re->set) * k);
+		if (!a_tmp) {
+			re->err = "Allocation failed";
+			return -1;
+		}
+		re->set = a_tmp;
+		re->aset = k;
+	}
+	memcpy(re->set[re->nset], bits, sizeof(*re->set));
+	if ((*e = re_node(re, RE_NOP, -1, -1, -1)) < 0
+	    || (*b = re_node(re, RE_SET, *e, -1, re->nset)) < 0) {
+		return -1;
+	}
+	re->nset++;
+	return 0;
+}
+
+/* a fragment for an assertion or, with RE_NOP, for nothing at all */
+int
+re_empty(struct regex *re, enum re_op op, int *b, int *e)
+{
+	if ((*e = re_node(re, RE_NOP, -1, -1, -1)) < 0) {
+		return -1;
+	}
+	*b = op == RE_NOP ? *e : re_node(re, op, *e, -1, -1);
+	return *b < 0 ? -1 : 0;
+}
+
+/* follow fragment *b, *e by b2, e2; *b < 0 is the empty fragment */
+void
+re_cat(struct regex *re, int *b, int *e, int b2, int e2)
+{
+	if (*b < 0) {
+		*b = b2;
+	} else {
+		re->node[*e].out = b2;
+	}
+	*e = e2;
+}
+
+/* apply the quantifier c, one of *+?, to the fragment *b, *e */
+int
+re_repeat(struct regex *re, int c, int *b, int *e)
+{
+	int s, end;
+
+	if ((end = re_node(re, RE_NOP, -1, -1, -1)) < 0
+	    || (s = re_node(re, RE_SPLIT, *b, end, -1)) < 0) {
+		return -1;
+	}
+	re->node[*e].out = c == '?' ? end : s;
+	if (c != '+') {
+		*b = s;
+	}
+	*e = end;
+	return 0;
+}
+
+/* alternate the fragment b2, e2 with *b, *e, taking *b < 0 as none yet */
+int
+re_or(struct regex *re, int *b, int *e, int b2, int e2)
+{
+	int s, end;
+
+	if (*b < 0) {
+		*b = b2;
+		*e = e2;
+		return 0;
+	}
+	if ((end = re_node(re, RE_NOP, -1, -1, -1)) < 0
+	    || (s = re_node(re, RE_SPLIT, *b, b2, -1)) < 0) {
+		return -1;
+	}
+	re->node[*e].out = end;
+	re->node[e2].out = end;
+	*b = s;
+	*e = end;
+	return 0;
+}
+
+/* the bytes of one UTF-8 character, folded as search keys are */
+int
+re_char(struct regex *re, const char *p, size_t len, int *b, int *e)
+{
+	uint64_t bits[4];
+	char d[16];
+	size_t i, n = key_fold(d, sizeof(d), p, len);
+	int b2, e2;
+
+	*b = -1;
+	for (i = 0; i < n; i++) {
+		memset(bits, 0, sizeof(bits));
+		bits[(unsigned char)d[i] >> 6] |= 1ULL << (d[i] & 63);
+		if (re_byte(re, bits, &b2, &e2) < 0) {
+			return -1;
+		}
+		re_cat(re, b, e, b2, e2);
+	}
+	return *b < 0 ? re_empty(re, RE_NOP, b, e) : 0;
+}
+
+/* a byte of UTF-8 lead, then any continuation bytes: one character */
+int
+re_multi(struct regex *re, int *b, int *e)
+{
+	uint64_t lead[4] = { 0, 0, 0, ~0ULL }, cont[4] = { 0, 0, ~0ULL, 0 };
+	int b2, e2;
+
+	if (re_byte(re, lead, b, e) < 0 || re_byte(re, cont, &b2, &e2) < 0
+	    || re_repeat(re, '*', &b2, &e2) < 0) {
+		return -1;
+	}
+	re_cat(re, b, e, b2, e2);
+	return 0;
+}
+
+/* length of the UTF-8 character at p, 1 for a stray byte */
+size_t
+re_len(const char *p)
+{
+	unsigned char c = *p;
+	size_t n = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1, i;
+
+	for (i = 1; i < n; i++) {
+		if (((unsigned char)p[i] & 0xc0) != 0x80) {
+			return 1;
+		}
+	}
+	return n;
+}
+
+/*
+ * add the ASCII bytes of the class escape c (d, w, s or, upper case,
+ * their negations) to bits; whether it takes other characters as well
+ */
+bool
+re_perl(int c, uint64_t *bits)
+{
+	bool neg = c != FOLD(c), in;
+	int i;
+
+	c = FOLD(c);
+	for (i = 0; i < 128; i++) {
+		in = ((c == 'd' || c == 'w') && i >= '0' && i <= '9')
+		    || (c == 'w' && (i == '_' || (i >= 'a' && i <= 'z')))
+		    || (c == 's' && (i == ' ' || (i >= '\t' && i <= '\r')));
+		if (in != neg) {
+			bits[i >> 6] |= 1ULL << (i & 63);
+		}
+	}
+	return neg;
+}
+
+/* a bracket expression at *pp, just past its [ */
+int
+re_class(struct regex *re, const char **pp, int *b, int *e)
+{
+	uint64_t bits[4] = { 0, 0, 0, 0 };
+	const char *p = *pp;
+	bool neg = false, multi = false, first = true;
+	int lo, hi, c, b2, e2, b3 = -1, e3 = -1;
+	size_t n;
+	char d[16];
+
+	if (*p == '^') {
+		neg = true;
+		p++;
+	}
+	for (; *p && (*p != ']' || first); first = false) {
+		if (*p == '\\' && p[1] && strchr("dDwWsS", p[1])) {
+			multi |= re_perl(p[1], bits);
+			p += 2;
+			continue;
+		}
+		if (*p == '\\' && p[1]) {
+			p++;
+		}
+		n = re_len(p);
+		if ((n > 1 || (unsigned char)*p >= 0x80)
+		    && (key_fold(d, sizeof(d), p, n) != 1
+		    || (unsigned char)d[0] >= 0x80)) {
+			/* a character outside ASCII is its own alternative */
+			if (neg) {
+				re->err = "Only ASCII in negated classes";
+				return -1;
+			}
+			if (re_char(re, p, n, &b2, &e2) < 0
+			    || re_or(re, &b3, &e3, b2, e2) < 0) {
+				return -1;
+			}
+			p += n;
+			continue;
+		}
+		if (n > 1 || (unsigned char)*p >= 0x80) {
+			/* folds to ASCII, as accented Latin letters do */
+			lo = hi = (unsigned char)d[0];
+			p += n;
+		} else {
+			lo = hi = (unsigned char)*p++;
+		}
+		if (*p == '-' && p[1] && p[1] != ']') {
+			p++;
+			if (*p == '\\' && p[1]) {
+				p++;
+			}
+			hi = (unsigned char)*p++;
+			if (hi >= 0x80 || hi < lo) {
+				re->err = "Bad range";
+				return -1;
+			}
+		}
+		for (c = lo; c <= hi; c++) {
+			bits[FOLD(c) >> 6] |= 1ULL << (FOLD(c) & 63);
+		}
+	}
+	if (*p != ']') {
+		re->err = "Missing ]";
+		return -1;
+	}
+	*pp = p + 1;
+	if (neg) {
+		bits[0] = ~bits[0];
+		bits[1] = ~bits[1];
+		multi = true;
+	}
+	*b = -1;
+	if ((bits[0] || bits[1]) && (re_byte(re, bits, &b2, &e2) < 0
+	    || re_or(re, b, e, b2, e2) < 0)) {
+		return -1;
+	}
+	if (multi && (re_multi(re, &b2, &e2) < 0
+	    || re_or(re, b, e, b2, e2) < 0)) {
+		return -1;
+	}
+	if (b3 >= 0 && re_or(re, b, e, b3, e3) < 0) {
+		return -1;
+	}
+	if (*b < 0) {
+		/* nothing can match, as in [^\x00-\x7f] with no characters */
+		memset(bits, 0, sizeof(bits));
+		return re_byte(re, bits, b, e);
+	}
+	return 0;
+}
+
+/* a single character, class, group or assertion at *pp */
+int
+re_atom(struct regex *re, const char **pp, int *b, int *e)
+{
+	uint64_t bits[4] = { 0, 0, 0, 0 };
+	const char *p = *pp;
+	size_t n;
+	int b2, e2;
+
+	switch (*p) {
+	case '(':
+		*pp = p + 1;
+		if (re_alt(re, pp, b, e) < 0) {
+			return -1;
+		}
+		if (**pp != ')') {
+			re->err = "Missing )";
+			return -1;
+		}
+		++*pp;
+		return 0;
+	case '[':
+		*pp = p + 1;
+		return re_class(re, pp, b, e);
+	case '^':
+	case '$':
+		*pp = p + 1;
+		return re_empty(re, *p == '^' ? RE_BOL : RE_EOL, b, e);
+	case '.':
+		*pp = p + 1;
+		bits[0] = bits[1] = ~0ULL;
+		*b = -1;
+		if (re_byte(re, bits, &b2, &e2) < 0
+		    || re_or(re, b, e, b2, e2) < 0
+		    || re_multi(re, &b2, &e2) < 0
+		    || re_or(re, b, e, b2, e2) < 0) {
+			return -1;
+		}
+		return 0;
+	case '*':
+	case '+':
+	case '?':
+		re->err = "Nothing to repeat";
+		return -1;
+	case '\\':
+		if (!p[1]) {
+			re->err = "Trailing \\";
+			return -1;
+		}
+		p++;
+		if (strchr("dDwWsS", *p)) {
+			*pp = p + 1;
+			*b = -1;
+			if (re_perl(*p, bits) && (re_multi(re, &b2, &e2) < 0
+			    || re_or(re, b, e, b2, e2) < 0)) {
+				return -1;
+			}
+			if (re_byte(re, bits, &b2, &e2) < 0) {
+				return -1;
+			}
+			return re_or(re, b, e, b2, e2);
+		}
+		break;
+	}
+	n = re_len(p);
+	*pp = p + n;
+	return re_char(re, p, n, b, e);
+}
+
+/* the bounds of a {m}, {m,} or {m,n} at p, n < 0 for none; its length */
+size_t
+re_count(const char *p, int *m, int *n)
+{
+	const char *q = p + 1;
+	char *end;
+	long lo, hi;
+
+	if (*p != '{' || *q < '0' || *q > '9') {
+		return 0;
+	}
+	lo = strtol(q, &end, 10);
+	hi = lo;
+	if (*end == ',') {
+		q = end + 1;
+		hi = -1;
+		if (*q >= '0' && *q <= '9') {
+			hi = strtol(q, &end, 10);
+		} else {
+			end = (char *)q;
+		}
+	}
+	if (*end != '}' || lo > RE_STATES || hi > RE_STATES
+	    || (hi >= 0 && hi < lo)) {
+		return 0;
+	}
+	*m = lo;
+	*n = hi;
+	return end + 1 - p;
+}
+
+/*
+ * an atom and the quantifiers after it, up to stop if given; a counted
+ * repeat parses the atom again for each copy it needs
+ */
+int
+re_piece(struct regex *re, const char **pp, const char *stop, int *b,
+    int *e)
+{
+	const char *start = *pp, *p, *q;
+	size_t len;
+	int i, m, n, b2, e2, rb, rend;
+
+	if (re_atom(re, pp, b, e) < 0) {
+		return -1;
+	}
+	for (p = *pp; !stop || p < stop; p = *pp) {
+		if (*p == '*' || *p == '+' || *p == '?') {
+			if (re_repeat(re, *p, b, e) < 0) {
+				return -1;
+			}
+			*pp = p + 1;
+			continue;
+		}
+		len = re_count(p, &m, &n);
+		if (len == 0 && *p == '{' && p[1] >= '0' && p[1] <= '9') {
+			re->err = "Bad repeat count";
+			return -1;
+		} else if (len == 0) {
+			break;
+		}
+		/* m copies, then n - m optional ones or, for {m,}, a star */
+		rb = -1;
+		for (i = 0; i < (n < 0 ? m + 1 : n); i++) {
+			q = start;
+			if (i == 0) {
+				b2 = *b;
+				e2 = *e;
+			} else if (re_piece(re, &q, p, &b2, &e2) < 0) {
+				return -1;
+			}
+			if (i >= m && re_repeat(re, n < 0 ? '*' : '?', &b2,
+			    &e2) < 0) {
+				return -1;
+			}
+			re_cat(re, &rb, &rend, b2, e2);
+		}
+		if (rb < 0 && re_empty(re, RE_NOP, &rb, &rend) < 0) {
+			return -1;
+		}
+		*b = rb;
+		*e = rend;
+		*pp = p + len;
+	}
+	return 0;
+}
+
+/* alternatives separated by | at *pp, up to an unmatched ) or the end */
+int
+re_alt(struct regex *re, const char **pp, int *b, int *e)
+{
+	int cb, ce, b2, e2;
+
+	*b = -1;
+	for (;;) {
+		cb = -1;
+		while (**pp && **pp != '|' && **pp != ')') {
+			if (re_piece(re, pp, NULL, &b2, &e2) < 0) {
+				return -1;
+			}
+			re_cat(re, &cb, &ce, b2, e2);
+		}
+		if (cb < 0 && re_empty(re, RE_NOP, &cb, &ce) < 0) {
+			return -1;
+		}
+		if (re_or(re, b, e, cb, ce) < 0) {
+			return -1;
+		}
+		if (**pp != '|') {
+			return 0;
+		}
+		++*pp;
+	}
+}
+
+/*
+ * compile pattern, or return NULL with *err saying why; a match may
+ * start anywhere, and names are matched by their folded keys
+ */
+struct regex *
+regex_new(const char *pattern, const char **err)
+{
+	struct regex *re;
+	const char *p = pattern;
+	int b, e, m, j, map[512];
+	size_t i, k, n;
+	uint8_t c[256];
+
+	re = calloc(1, sizeof(struct regex));
+	if (!re) {
+		*err = "Allocation failed";
+		return NULL;
+	}
+	if (re_alt(re, &p, &b, &e) < 0) {
+		goto error;
+	}
+	if (*p == ')') {
+		re->err = "Unmatched )";
+		goto error;
+	}
+	/* the last state, which re_end relies on */
+	if ((m = re_node(re, RE_MATCH, -1, -1, -1)) < 0) {
+		goto error;
+	}
+	re->node[e].out = m;
+	re->start = b;
+
+	/* split the bytes into classes by the sets that hold them */
+	memset(c, 0, sizeof(c));
+	re->ncls = 1;
+	for (k = 0; k < re->nset; k++) {
+		for (i = 0; i < 2 * re->ncls; i++) {
+			map[i] = -1;
+		}
+		n = 0;
+		for (i = 0; i < 256; i++) {
+			j = c[i] * 2 + (re->set[k][i >> 6] >> (i & 63) & 1);
+			if (map[j] < 0) {
+				map[j] = n++;
+			}
+			c[i] = map[j];
+		}
+		re->ncls = n;
+	}
+	for (i = 256; i-- > 0;) {
+		re->rep[c[i]] = i;
+		re->cls[i] = c[FOLD(i)];
+	}
+
+	re->mark = calloc(re->n, sizeof(uint32_t));
+	re->stack = malloc(sizeof(int) * (2 * re->n + 1));
+	re->tmp = malloc(sizeof(int) * re->n);
+	re->dfa = malloc(sizeof(struct re_dfa) * RE_CACHE);
+	re->next = malloc(sizeof(int) * RE_CACHE * re->ncls);
+	re->tab = malloc(sizeof(int) * RE_CACHE * 2);
+	if (!re->mark || !re->stack || !re->tmp || !re->dfa || !re->next
+	    || !re->tab) {
+		re->err = "Allocation failed";
+		goto error;
+	}
+	re_flush(re);
+	return re;
+error:
+	*err = re->err;
+	regex_free(re);
+	return NULL;
+}
+
+void
+regex_free(struct regex *re)
+{
+	if (!re) {
+		return;
+	}
+	free(re->node);
+	free(re->set);
+	free(re->mark);
+	free(re->stack);
+	free(re->tmp);
+	free(re->dfa);
+	free(re->next);
+	free(re->tab);
+	free(re->list);
+	free(re);
+}
+
+/* drop every dfa state, for when the cache is full */
+void
+re_flush(struct regex *re)
+{
+	size_t i;
+
+	re->ndfa = 0;
+	re->nlist = 0;
+	re->init = -1;
+	re->flushes++;
+	for (i = 0; i < RE_CACHE * 2; i++) {
+		re->tab[i] = -1;
+	}
+}
+
+/*
+ * mark the states reached from s without consuming a byte; ^ is passed
+ * only at the start of the string and $ only at its end
+ */
+void
+re_close(struct regex *re, int s, bool bol, bool eol)
+{
+	struct re_node *nd;
+	size_t sp = 0;
+
+	re->stack[sp++] = s;
+	while (sp > 0) {
+		s = re->stack[--sp];
+		if (s < 0 || re->mark[s] == re->gen) {
+			continue;
+		}
+		re->mark[s] = re->gen;
+		nd = &re->node[s];
+		if (nd->op == RE_NOP || nd->op == RE_SPLIT
+		    || (nd->op == RE_BOL && bol) || (nd->op == RE_EOL && eol)) {
+			re->stack[sp++] = nd->out;
+		}
+		if (nd->op == RE_SPLIT) {
+			re->stack[sp++] = nd->out1;
+		}
+	}
+}
+
+/* start marking a new set of states */
+void
+re_mark(struct regex *re)
+{
+	if (++re->gen == 0) {
+		memset(re->mark, 0, sizeof(uint32_t) * re->n);
+		re->gen = 1;
+	}
+}
+
+/*
+ * the dfa state for the marked states, cached under the states that
+ * consume a byte or end the match; -1 if memory ran out
+ */
+int
+re_state(struct regex *re)
+{
+	struct re_dfa *d;
+	void *a_tmp;
+	size_t i, n = 0, a;
+	uint64_t h;
+	bool match = false;
+	int k;
+
+	for (i = 0; i < re->n; i++) {
+		if (re->mark[i] != re->gen || re->node[i].op == RE_NOP
+		    || re->node[i].op == RE_SPLIT
+		    || re->node[i].op == RE_BOL) {
+			continue;
+		}
+		match |= re->node[i].op == RE_MATCH;
+		re->tmp[n++] = i;
+	}
+	h = hash(HASH_INIT, (const char *)re->tmp, sizeof(int) * n);
+	for (k = re->tab[h % (RE_CACHE * 2)]; k >= 0; k = re->dfa[k].chain) {
+		d = &re->dfa[k];
+		if (d->h == h && d->n == n && memcmp(re->list + d->off,
+		    re->tmp, sizeof(int) * n) == 0) {
+			return k;
+		}
+	}
+	if (re->ndfa == RE_CACHE) {
+		re_flush(re);
+	}
+	if (re->nlist + n > re->alist) {
+		a = MAX(re->alist * 2, re->nlist + n);
+		a_tmp = realloc(re->list, sizeof(int) * a);
+		if (!a_tmp) {
+			return -1;
+		}
+		re->list = a_tmp;
+		re->alist = a;
+	}
+	memcpy(re->list + re->nlist, re->tmp, sizeof(int) * n);
+	k = re->ndfa++;
+	d = &re->dfa[k];
+	d->off = re->nlist;
+	d->n = n;
+	d->h = h;
+	d->match = match;
+	d->end = -1;
+	d->chain = re->tab[h % (RE_CACHE * 2)];
+	re->tab[h % (RE_CACHE * 2)] = k;
+	re->nlist += n;
+	for (i = 0; i < re->ncls; i++) {
+		re->next[(size_t)k * re->ncls + i] = -1;
+	}
+	return k;
+}
+
+/*
+ * the dfa state after state k reads a byte of class c; a move that ends
+ * the search is kept as RE_YES or RE_NO, for regex_match to check only
+ * when it finds a move below zero
+ */
+int
+re_step(struct regex *re, int k, int c)
+{
+	struct re_node *nd;
+	unsigned int b = re->rep[c];
+	unsigned long flushes = re->flushes;
+	size_t i;
+	int *l = re->list + re->dfa[k].off, next;
+
+	re_mark(re);
+	for (i = 0; i < re->dfa[k].n; i++) {
+		nd = &re->node[l[i]];
+		if (nd->op == RE_SET
+		    && re->set[nd->set][b >> 6] >> (b & 63) & 1) {
+			re_close(re, nd->out, false, false);
+		}
+	}
+	/* a match may also begin at the next byte */
+	re_close(re, re->start, false, false);
+	next = re_state(re);
+	if (next >= 0 && flushes == re->flushes) {
+		re->next[(size_t)k * re->ncls + c] = re->dfa[next].match
+		    ? RE_YES : re->dfa[next].n == 0 ? RE_NO
+		    : next * (int)re->ncls;
+	}
+	return next;
+}
+
+/*
+ * whether state k, at the end of the string, has matched; bol for an
+ * empty string, where the end is the start as well
+ */
+bool
+re_end(struct regex *re, int k, bool bol)
+{
+	struct re_dfa *d = &re->dfa[k];
+	size_t i;
+
+	if (d->end < 0 || bol) {
+		re_mark(re);
+		for (i = 0; i < d->n; i++) {
+			if (re->node[re->list[d->off + i]].op == RE_EOL) {
+				re_close(re, re->list[d->off + i], bol, true);
+			}
+		}
+		if (bol) {
+			return re->mark[re->n - 1] == re->gen;
+		}
+		d->end = re->mark[re->n - 1] == re->gen;
+	}
+	return d->end;
+}
+
+/* whether re matches somewhere in the len bytes at s, -1 on failure */
+int
+regex_match(struct regex *re, const char *s, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)s;
+	size_t i, row;
+	int k = re->init, next;
+
+	if (k < 0) {
+		re_mark(re);
+		re_close(re, re->start, true, false);
+		k = re->init = re_state(re);
+		if (k < 0) {
+			return -1;
+		}
+	}
+	if (re->dfa[k].match || re->dfa[k].n == 0) {
+		return re->dfa[k].match;
+	}
+	/* a move is to the row of the next state, k * ncls */
+	row = (size_t)k * re->ncls;
+	for (i = 0; i < len; i++) {
+		next = re->next[row + re->cls[p[i]]];
+		if (next < 0 && next != -1) {
+			return next == RE_YES;
+		} else if (next < 0) {
+			k = re_step(re, row / re->ncls, re->cls[p[i]]);
+			if (k < 0) {
+				return -1;
+			} else if (re->dfa[k].match || re->dfa[k].n == 0) {
+				return re->dfa[k].match;
+			}
+			next = k * re->ncls;
+		}
+		row = next;
+	}
+	return re_end(re, row / re->ncls, len == 0);
+}
+
+/* whether the name or the url of s matches re, -1 on failure */
+int
+station_regex(const struct station_list *sl, struct regex *re,
+    const struct station *s)
+{
+	int m = regex_match(re, field_ptr(sl, s->key), s->key.len);
+
+	if (m == 0) {
+		m = regex_match(re, field_ptr(sl, s->url), s->url.len);
+	}
+	return m;
+}
+
+/* field named by a word starting at p, k set past its colon or to 0 */
+enum term
+term_field(const char *p, size_t *k)
+{
+	/* in the order of enum term */
+	static const char *const names[] = { "name:", "url:", "host:" };
+	enum term f;
+
+	for (f = TERM_NAME; f <= TERM_HOST; f++) {
+		for (*k = 0; names[f][*k] && FOLD(p[*k]) == names[f][*k];
+		    (*k)++)
+			;
+		if (!names[f][*k]) {
+			return f;
+		}
+	}
+	*k = 0;
+	return TERM_NAME;
+}
+
+/* whether a word of cmd names a field, making its words terms */
+bool
+query_fields(const char *cmd)
+{
+	const char *p;
+	size_t k;
+
+	for (p = cmd; *p; p += strcspn(p, " ")) {
+		p += strspn(p, " ");
+		if (term_field(p, &k), k > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* whether cmd is searched for in a single level, not a byte at a time */
+bool
+search_whole(const char *cmd)
+{
+	return cmd[0] == RE_MARK || query_fields(cmd);
+}
+
+/* cmd as the terms to match, and the signatures they need */
+void
+query_parse(struct query *fq, const char *cmd)
+{
+	char *d = fq->buf, *end = fq->buf + sizeof(fq->buf);
+	const char *p = cmd;
+	bool words = query_fields(cmd);
+	enum term f;
+	size_t k, len, n;
+
+	fq->n = 0;
+	memset(fq->sig, 0, sizeof(fq->sig));
+	memset(fq->usig, 0, sizeof(fq->usig));
+	while (*p && fq->n < QUERY_TERMS && d < end) {
+		if (words) {
+			p += strspn(p, " ");
+		}
+		len = words ? strcspn(p, " ") : strlen(p);
+		f = term_field(p, &k);
+		if (f == TERM_NAME) {
+			n = key_fold(d, end - d, p + k, len - k);
+		} else {
+			for (n = 0; n < len - k && d + n + 1 < end; n++) {
+				d[n] = FOLD(p[k + n]);
+			}
+			d[n] = '\0';
+		}
+		p += len;
+		if (n == 0) {
+			continue;
+		}
+		/* a host is part of the url */
+		sig_add(f == TERM_NAME ? fq->sig : fq->usig, d, n);
+		fq->t[fq->n].f = f;
+		fq->t[fq->n].v = d;
+		fq->t[fq->n].len = n;
+		fq->n++;
+		d += n + 1;
+	}
+}
+
+/* whether ASCII folded q is in s, ignoring the case of ASCII in s */
+bool
+url_find(const char *s, size_t len, const char *q, size_t qlen)
+{
+	size_t i, k;
+
+	for (i = 0; i + qlen <= len; i++) {
+		for (k = 0; k < qlen && FOLD(s[i + k]) == (unsigned char)q[k];
+		    k++)
+			;
+		if (k == qlen) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* whether station id matches every term of fq */
+bool
+query_match(const struct station_list *sl, const struct query *fq,
+    size_t id)
+{
+	const struct station *s = &sl->stations[id];
+	const char *u = field_ptr(sl, s->url), *h;
+	size_t i, len;
+
+	for (i = 0; i < fq->n; i++) {
+		switch (fq->t[i].f) {
+		case TERM_NAME:
+			if (!key_find(field_ptr(sl, s->key), s->key.len,
+			    fq->t[i].v)) {
+				return false;
+			}
+			break;
+		case TERM_URL:
+			if (!url_find(u, s->url.len, fq->t[i].v,
+			    fq->t[i].len)) {
+				return false;
+			}
+			break;
+		case TERM_HOST:
+			h = url_host(u, s->url.len, &len);
+			if (len != fq->t[i].len
+			    || !url_find(h, len, fq->t[i].v, len)) {
+				return false;
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+/* cmd as it is searched for: folded, unless matched whole */
+void
+search_query(char *q, size_t size, const char *cmd)
+{
+	if (search_whole(cmd)) {
+		strcpy_t(q, cmd, size);
+	} else {
+		key_fold(q, size, cmd, strlen(cmd));
+	}
+}
+
+/* order of two size_t, for qsort */
+int
+size_cmp(const void *a, const void *b)
+{
+	size_t x = *(const size_t *)a, y = *(const size_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* index of the first of the n ids, in list order, at or after pos */
+size_t
+seq_rank(const struct station_list *sl, const size_t *ids, size_t n,
+    size_t pos)
+{
+	size_t lo = 0, hi = n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (seq_pos(sl, ids[mid]) < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* room for n more ids after the last level */
+int
+narrow_reserve(struct narrow *nr, size_t n)
+{
+	void *a_tmp;
+
+	if (nr->len + n <= nr->a_len) {
+		return 0;
+	}
+	n = MAX(nr->len + n, nr->a_len * 2);
+	a_tmp = realloc(nr->ids, sizeof(size_t) * n);
+	if (!a_tmp) {
+		return -1;
+	}
+	nr->ids = a_tmp;
+	nr->a_len = n;
+	return 0;
+}
+
+/*
+ * a single level for all of q from the trigram index, its ids sorted
+ * into list order; -1 if the index cannot answer
+ */
+int
+narrow_seed(struct station_list *sl, const char *q)
+{
+	struct narrow *nr = &sl->nar;
+	uint32_t *ids;
+	ssize_t i, m;
+
+	m = index_query(sl, q, &ids);
+	if (m < 0 || narrow_reserve(nr, m) < 0) {
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < m; i++) {
+		nr->ids[i] = seq_pos(sl, ids[i]);
+	}
+	qsort(nr->ids, m, sizeof(size_t), size_cmp);
+	for (i = 0; i < m; i++) {
+		nr->ids[i] = *seq_ref(sl, nr->ids[i]);
+	}
+	free(ids);
+	strcpy_t(nr->q, q, sizeof(nr->q));
+	nr->base = strlen(q) - 1;
+	nr->lv[0] = 0;
+	nr->lv[1] = m;
+	nr->len = m;
+	nr->nlv = 1;
+	return 0;
+}
+
+/*
+ * add the level for the next byte of q, filtering the level before; 1
+ * if the search was cancelled first, leaving the levels as they were
+ */
+int
+narrow_push(struct station_list *sl, const char *q)
+{
+	struct narrow *nr = &sl->nar;
+	struct station *s;
+	struct block *blk;
+	size_t i, b, start, from, slice = 0, pos = 0;
+	size_t k = nr->nlv, c = nr->base + nr->nlv;
+	char t[sizeof(nr->q)];
+	uint64_t sig[SIG_BITS / 64] = {0};
+
+	/* nr->q gains the byte once the level is whole */
+	memcpy(t, q, c + 1);
+	t[c + 1] = '\0';
+	sig_add(sig, t, c + 1);
+	start = nr->len;
+	from = k ? nr->lv[k - 1] : 0;
+	/* at most every station of the level before survives */
+	if (narrow_reserve(nr, k ? start - from : sl->size) < 0) {
+		return -1;
+	}
+	if (k == 0) {
+		for (b = 0; b < sl->nblocks; b++) {
+			blk = sl->blocks[b];
+			/* none in a block lacking a byte or pair of t */
+			i = sig_has(block_sig(sl, blk), sig) ? 0 : blk->n;
+			for (; i < blk->n; i++) {
+				s = &sl->stations[blk->ids[i]];
+				if (key_find(field_ptr(sl, s->key),
+				    s->key.len, t)) {
+					nr->ids[nr->len++] = blk->ids[i];
+				}
+			}
+			pos += blk->n;
+			if ((slice += blk->n) >= SEARCH_SLICE) {
+				slice = 0;
+				if (!search_yield(sl, pos, sl->size)) {
+					nr->len = start;
+					return 1;
+				}
+			}
+		}
+	} else {
+		for (i = from; i < start; i++) {
+			if (i > from && (i - from) % SEARCH_SLICE == 0
+			    && !search_yield(sl, i - from, start - from)) {
+				nr->len = start;
+				return 1;
+			}
+			s = &sl->stations[nr->ids[i]];
+			if (key_find(field_ptr(sl, s->key), s->key.len, t)) {
+				nr->ids[nr->len++] = nr->ids[i];
+			}
+		}
+	}
+	nr->q[c] = q[c];
+	nr->q[c + 1] = '\0';
+	nr->lv[k] = start;
+	nr->lv[k + 1] = nr->len;
+	nr->nlv++;
+	return 0;
+}
+
+/*
+ * ids that may match fq from the index, in list order, for the single
+ * level of fq: 1 if a host or name term could be looked up
+ */
+int
+narrow_lookup(struct station_list *sl, const struct query *fq)
+{
+	struct narrow *nr = &sl->nar;
+	uint32_t *ids = NULL;
+	ssize_t i, m = -1;
+	size_t k, n = 0;
+
+	for (k = 0; k < fq->n && m < 0; k++) {
+		if (fq->t[k].f == TERM_HOST) {
+			m = host_query(sl, fq->t[k].v, &ids);
+		}
+	}
+	for (k = 0; k < fq->n && m < 0; k++) {
+		if (fq->t[k].f == TERM_NAME) {
+			m = index_query(sl, fq->t[k].v, &ids);
+		}
+	}
+	if (m < 0) {
+		return 0;
+	}
+	if (narrow_reserve(nr, m) < 0) {
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < m; i++) {
+		if (query_match(sl, fq, ids[i])) {
+			nr->ids[n++] = seq_pos(sl, ids[i]);
+		}
+	}
+	qsort(nr->ids, n, sizeof(size_t), size_cmp);
+	for (k = 0; k < n; k++) {
+		nr->ids[k] = *seq_ref(sl, nr->ids[k]);
+	}
+	nr->len = n;
+	free(ids);
+	return 1;
+}
+
+/*
+ * the single level for q, a regular expression or a query naming
+ * fields: a longer pattern need not match less, so each one is looked
+ * up or scanned for afresh, and one that does not compile, perhaps as
+ * it is still being typed, matches nothing
+ */
+int
+narrow_whole(struct station_list *sl, const char *q)
+{
+	struct narrow *nr = &sl->nar;
+	struct regex *re = NULL;
+	struct query *fq = NULL;
+	struct block *blk;
+	const char *err;
+	size_t b, i, slice = 0, pos = 0;
+	bool cut = false;
+	int m = 0;
+
+	if ((nr->nlv == 1 && strcmp(nr->q, q) == 0)
+	    || narrow_cached(sl, q) == 0) {
+		return 0;
+	}
+	/* no level until it is whole */
+	nr->nlv = 0;
+	nr->len = 0;
+	if (q[0] == RE_MARK) {
+		re = regex_new(q + 1, &err);
+	} else if ((fq = malloc(sizeof(struct query)))) {
+		query_parse(fq, q);
+	} else {
+		return -1;
+	}
+	if (fq && (m = narrow_lookup(sl, fq)) != 0) {
+		free(fq);
+		fq = NULL;
+	} else if ((re || fq) && narrow_reserve(nr, sl->size) < 0) {
+		m = -1;
+	}
+	for (b = 0; (re || fq) && m >= 0 && b < sl->nblocks; b++) {
+		blk = sl->blocks[b];
+		/* a block that cannot hold a match is passed over */
+		i = fq && !block_fits(sl, blk, fq) ? blk->n : 0;
+		for (; m >= 0 && i < blk->n; i++) {
+			m = re ? station_regex(sl, re,
+			    &sl->stations[blk->ids[i]])
+			    : query_match(sl, fq, blk->ids[i]);
+			if (m > 0) {
+				nr->ids[nr->len++] = blk->ids[i];
+			}
+		}
+		pos += blk->n;
+		if ((slice += blk->n) >= SEARCH_SLICE) {
+			slice = 0;
+			if (m >= 0 && !search_yield(sl, pos, sl->size)) {
+				cut = true;
+				break;
+			}
+		}
+	}
+	regex_free(re);
+	free(fq);
+	if (m < 0 || cut) {
+		nr->len = 0;
+		return m < 0 ? -1 : 1;
+	}
+	strcpy_t(nr->q, q, sizeof(nr->q));
+	nr->base = strlen(q) - 1;
+	nr->lv[0] = 0;
+	nr->lv[1] = nr->len;
+	nr->nlv = 1;
+	return 0;
+}
+
+/*
+ * bring the levels up to cmd folded, keeping those for the part of it
+ * they were built for; the top level then holds every match for cmd,
+ * unless the search was cancelled on the way and 1 is returned
+ */
+int
+narrow_sync(struct station_list *sl, const char *cmd)
+{
+	struct narrow *nr = &sl->nar;
+	char q[sizeof(nr->q)];
+	size_t k, n;
+	bool whole = search_whole(cmd);
+	int rv;
+
+	if (nr->gen != sl->gen || nr->size != sl->size
+	    || nr->whole != whole) {
+		nr->nlv = 0;
+		nr->gen = sl->gen;
+		nr->size = sl->size;
+		nr->whole = whole;
+	}
+	if (nr->whole) {
+		return narrow_whole(sl, cmd);
+	}
+	n = key_fold(q, sizeof(q), cmd, strlen(cmd));
+	/* a cached search stands in for building up to it */
+	if ((nr->nlv == 0 || strcmp(nr->q, q) != 0)
+	    && narrow_cached(sl, q) == 0) {
+		return 0;
+	}
+	for (k = 0; k < nr->base + nr->nlv && k < n && nr->q[k] == q[k]; k++)
+		;
+	if (k <= nr->base) {
+		nr->nlv = 0;
+		nr->base = 0;
+		nr->len = 0;
+	} else if (k < nr->base + nr->nlv) {
+		nr->nlv = k - nr->base;
+		nr->len = nr->lv[nr->nlv];
+		nr->q[k] = '\0';
+	}
+	/* starting over, the first level is for all of q */
+	if (nr->nlv == 0 && n > 0) {
+		if (n >= 3 && narrow_seed(sl, q) == 0) {
+			return 0;
+		}
+		memcpy(nr->q, q, n - 1);
+		nr->base = n - 1;
+	}
+	while (nr->base + nr->nlv < n) {
+		if ((rv = narrow_push(sl, q)) > 0) {
+			return 1;
+		} else if (rv < 0) {
+			nr->nlv = 0;
+			nr->base = 0;
+			nr->len = 0;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* matches for cmd in list order, if the levels are current for it */
+size_t *
+narrow_top(const struct station_list *sl, const char *cmd, size_t *n)
+{
+	const struct narrow *nr = &sl->nar;
+	char q[sizeof(nr->q)];
+
+	search_query(q, sizeof(q), cmd);
+	if (nr->nlv == 0 || nr->gen != sl->gen || nr->size != sl->size
+	    || nr->whole != search_whole(cmd) || strcmp(nr->q, q) != 0) {
+		return NULL;
+	}
+	*n = nr->lv[nr->nlv] - nr->lv[nr->nlv - 1];
+	return nr->ids + nr->lv[nr->nlv - 1];
+}
+
+/* the entry of the cache for q, if any */
+struct qentry *
+qcache_find(struct station_list *sl, const char *q)
+{
+	struct qcache *qc = &sl->qc;
+	size_t i;
+
+	for (i = 0; i < qc->n; i++) {
+		if (strcmp(qc->e[i].q, q) == 0) {
+			return &qc->e[i];
+		}
+	}
+	return NULL;
+}
+
+/* drop entry i of the cache */
+void
+qcache_drop(struct station_list *sl, size_t i)
+{
+	struct qcache *qc = &sl->qc;
+
+	qc->ids -= qc->e[i].n;
+	free(qc->e[i].ids);
+	regex_free(qc->e[i].re);
+	free(qc->e[i].fq);
+	qc->e[i] = qc->e[--qc->n];
+}
+
+/*
+ * keep the n matches for q, as searched for, in place of the least
+ * recently used entries
+ */
+void
+qcache_put(struct station_list *sl, const char *q, const size_t *ids,
+    size_t n)
+{
+	struct qcache *qc = &sl->qc;
+	struct qentry *e;
+	size_t i, old;
+
+	if ((e = qcache_find(sl, q))) {
+		qcache_drop(sl, e - qc->e);
+	}
+	if (n > QCACHE_IDS) {
+		return;
+	}
+	while (qc->n == QCACHE_N || qc->ids + n > QCACHE_IDS) {
+		for (old = 0, i = 1; i < qc->n; i++) {
+			if (qc->e[i].used < qc->e[old].used) {
+				old = i;
+			}
+		}
+		qcache_drop(sl, old);
+	}
+	e = &qc->e[qc->n];
+	e->ids = malloc(sizeof(size_t) * MAX(n, 1));
+	if (!e->ids) {
+		return;
+	}
+	memcpy(e->ids, ids, sizeof(size_t) * n);
+	strcpy_t(e->q, q, sizeof(e->q));
+	e->re = NULL;
+	e->fq = NULL;
+	if (q[0] != RE_MARK && query_fields(q)
+	    && (e->fq = malloc(sizeof(struct query)))) {
+		query_parse(e->fq, q);
+	}
+	e->n = n;
+	e->gen = sl->gen;
+	e->used = ++qc->tick;
+	qc->ids += n;
+	qc->n++;
+}
+
+/*
+ * entries, as a mask, whose matches include station id; for a pattern
+ * that cannot be checked, all of them
+ */
+unsigned
+qcache_hits(struct station_list *sl, size_t id)
+{
+	struct qcache *qc = &sl->qc;
+	struct qentry *e;
+	const struct station *s = &sl->stations[id];
+	const char *err;
+	unsigned m = 0;
+	size_t i;
+
+	for (i = 0; i < qc->n; i++) {
+		e = &qc->e[i];
+		if (e->gen != sl->gen) {
+			continue;
+		}
+		if (e->q[0] != RE_MARK && query_fields(e->q)) {
+			if (!e->fq || query_match(sl, e->fq, id)) {
+				m |= 1u << i;
+			}
+			continue;
+		}
+		if (e->q[0] != RE_MARK) {
+			if (key_find(field_ptr(sl, s->key), s->key.len, e->q)) {
+				m |= 1u << i;
+			}
+			continue;
+		}
+		if (!e->re) {
+			e->re = regex_new(e->q + 1, &err);
+		}
+		if (!e->re || station_regex(sl, e->re, s) != 0) {
+			m |= 1u << i;
+		}
+	}
+	return m;
+}
+
+/*
+ * after a change to the list at gen, drop the entries in mask, and those
+ * already out of date; the rest still hold and now stand for sl->gen
+ */
+void
+qcache_sync(struct station_list *sl, unsigned mask, unsigned long gen)
+{
+	struct qcache *qc = &sl->qc;
+	size_t i = qc->n;
+
+	/* from the end, as a drop moves the last entry into its place */
+	while (i-- > 0) {
+		if (qc->e[i].gen != gen || mask & (1u << i)) {
+			qcache_drop(sl, i);
+		} else {
+			qc->e[i].gen = sl->gen;
+		}
+	}
+}
+
+/* load the cached matches for q as the single level, if there are any */
+int
+narrow_cached(struct station_list *sl, const char *q)
+{
+	struct narrow *nr = &sl->nar;
+	struct qentry *e = qcache_find(sl, q);
+
+	if (!e || e->gen != sl->gen) {
+		return -1;
+	}
+	nr->nlv = 0;
+	nr->len = 0;
+	if (narrow_reserve(nr, e->n) < 0) {
+		return -1;
+	}
+	memcpy(nr->ids, e->ids, sizeof(size_t) * e->n);
+	strcpy_t(nr->q, q, sizeof(nr->q));
+	nr->base = strlen(q) - 1;
+	nr->lv[0] = 0;
+	nr->lv[1] = e->n;
+	nr->len = e->n;
+	nr->nlv = 1;
+	nr->gen = sl->gen;
+	nr->size = sl->size;
+	nr->whole = search_whole(q);
+	e->used = ++sl->qc.tick;
+	return 0;
+}
+
+/*
+ * matches for cmd in list order, from the levels or, while the worker
+ * leaves them alone, the cache
+ */
+size_t *
+search_top(struct station_list *sl, const char *cmd, size_t *n)
+{
+	size_t *ids;
+	char q[sizeof(sl->nar.q)];
+
+	ids = narrow_top(sl, cmd, n);
+	if (ids || sl->srch.busy) {
+		return ids;
+	}
+	search_query(q, sizeof(q), cmd);
+	return narrow_cached(sl, q) == 0 ? narrow_top(sl, cmd, n) : NULL;
+}
+
+/* cache the matches for cmd, a search the user settled on */
+void
+search_keep(struct station_list *sl, const char *cmd)
+{
+	size_t *ids, n;
+	char q[sizeof(sl->nar.q)];
+
+	ids = narrow_top(sl, cmd, &n);
+	if (ids) {
+		search_query(q, sizeof(q), cmd);
+		qcache_put(sl, q, ids, n);
+	}
+}
+
+/*
+ * move the cursor to the first match for q after where the search began;
+ * it stays put while the matches are found in the background
+ */
+void
+search_inc(struct station_list *sl, const char *q)
+{
+	size_t *ids, n, k;
+
+	ids = q[0] ? search_top(sl, q, &n) : NULL;
+	if (q[0] && !ids) {
+		search_want(sl, JOB_NARROW, q, THEN_INC);
+		return;
+	}
+	search_cancel(sl);
+	sl->index = sl->nar.from;
+	sl->pg_i = sl->nar.from_pg;
+	if (!ids) {
+		return;
+	}
+	k = seq_rank(sl, ids, n, sl->nar.from + 1);
+	if (k < n) {
+		sl->index = seq_pos(sl, ids[k]);
+	}
+}
+
+/* show only the stations matching q, found over the next passes */
+void
+filter_start(struct station_list *sl, const char *q)
+{
+	struct filter *ft = &sl->filt;
+	const char *err;
+
+	ft->regex = q[0] == RE_MARK;
+	regex_free(ft->re);
+	ft->re = ft->regex ? regex_new(q + 1, &err) : NULL;
+	if (!ft->regex) {
+		query_parse(&ft->fq, q);
+	}
+	ft->on = true;
+	ft->n = 0;
+	ft->next = 0;
+	ft->gen = sl->gen;
+	ft->pg = 0;
+}
+
+/*
+ * check up to n more stations against the filter, starting over if the
+ * list changed; whether the view is complete
+ */
+int
+filter_step(struct station_list *sl, size_t n)
+{
+	struct filter *ft = &sl->filt;
+	struct station *s;
+	struct block *blk;
+	size_t b, off, id, k;
+	void *a_tmp;
+
+	if (!ft->on) {
+		return 1;
+	}
+	/* an append leaves the ids found so far, any other change not */
+	if (ft->gen != sl->gen) {
+		if (sl->edit_gen > ft->gen) {
+			ft->n = 0;
+			ft->next = 0;
+		}
+		ft->gen = sl->gen;
+	}
+	if (ft->next >= sl->size) {
+		return 1;
+	}
+	b = fen_find(sl, ft->next, &off);
+	for (; n > 0 && b < sl->nblocks; b++, off = 0) {
+		blk = sl->blocks[b];
+		/* a block skipped counts as one station checked */
+		if (!ft->regex && !block_fits(sl, blk, &ft->fq)) {
+			ft->next += blk->n - off;
+			n--;
+			continue;
+		}
+		for (; n > 0 && off < blk->n; n--, off++, ft->next++) {
+			id = blk->ids[off];
+			s = &sl->stations[id];
+			if (ft->regex ? !ft->re || station_regex(sl, ft->re,
+			    s) <= 0 : !query_match(sl, &ft->fq, id)) {
+				continue;
+			}
+			if (ft->n == ft->a) {
+				k = ft->a ? ft->a * 2 : 1024;
+				a_tmp = realloc(ft->ids, sizeof(size_t) * k);
+				if (!a_tmp) {
+					return 1;
+				}
+				ft->ids = a_tmp;
+				ft->a = k;
+			}
+			ft->ids[ft->n++] = id;
+		}
+	}
+	if (ft->next < sl->size) {
+		return 0;
+	}
+	filter_snap(sl);
+	return 1;
+}
+
+/* put the cursor on a row of the whole view, unless an edit holds it */
+void
+filter_snap(struct station_list *sl)
+{
+	struct filter *ft = &sl->filt;
+	size_t k;
+
+	if (ft->on && ft->next >= sl->size && ft->n > 0
+	    && sl->state == NORMAL) {
+		k = MIN(seq_rank(sl, ft->ids, ft->n, sl->index), ft->n - 1);
+		sl->index = seq_pos(sl, ft->ids[k]);
+	}
+}
+
+/* j, k, g and G over the rows of the filtered view */
+void
+filter_move(struct station_list *sl, int c)
+{
+	struct filter *ft = &sl->filt;
+	size_t k;
+
+	/* ids from before an edit may be out of order, wait for new ones */
+	if (ft->n == 0 || sl->edit_gen > ft->gen) {
+		return;
+	}
+	k = seq_rank(sl, ft->ids, ft->n, sl->index);
+	switch (c) {
+	case 'g':
+		k = 0;
+		break;
+	case 'G':
+		k = ft->n - 1;
+		break;
+	case 'j':
+		if (k < ft->n && seq_pos(sl, ft->ids[k]) == sl->index) {
+			k++;
+		}
+		if (k == ft->n) {
+			return;
+		}
+		break;
+	case 'k':
+		if (k == 0) {
+			return;
+		}
+		k--;
+		break;
+	}
+	sl->index = seq_pos(sl, ft->ids[k]);
+}
+
+/* take the station id at pos, about to be deleted, out of the view */
+void
+filter_drop(struct station_list *sl, size_t pos, size_t id)
+{
+	struct filter *ft = &sl->filt;
+	size_t k;
+
+	if (!ft->on || sl->edit_gen > ft->gen) {
+		return;
+	}
+	k = seq_rank(sl, ft->ids, ft->n, pos);
+	if (k < ft->n && ft->ids[k] == id) {
+		memmove(ft->ids + k, ft->ids + k + 1,
+		    sizeof(size_t) * (ft->n - k - 1));
+		ft->n--;
+	}
+	if (pos < ft->next) {
+		ft->next--;
+	}
+}
+
+/*
+ * 0 for space and punctuation, 1 letter or not ASCII, 2 digit; keys are
+ * folded, so there is no case to tell words apart by
+ */
+int
+fuzzy_class(int c)
+{
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+		return 1;
+	}
+	if (c >= '0' && c <= '9') {
+		return 2;
+	}
+	return c >= 0x80;
+}
+
+/*
+ * score of the shortest span of key s holding the bytes of the folded query
+ * q in order, from the bonuses of its matches and the cost of its gaps;
+ * -1 if s does not hold them
+ */
+int
+fuzzy_score(const char *s, size_t len, const char *q, size_t qn)
+{
+	size_t i, j, start, end;
+	int score = 0, bonus, first = 0, run = 0, prev, cur;
+	bool gap = false;
+
+	end = subseq(s, len, q, qn);
+	if (end == 0) {
+		return -1;
+	}
+	/* back from the end of the first match for the latest start */
+	for (i = end, j = qn; j > 0;) {
+		i--;
+		if (s[i] == q[j - 1]) {
+			j--;
+		}
+	}
+	start = i;
+	prev = start ? fuzzy_class((unsigned char)s[start - 1]) : 0;
+	for (i = start, j = 0; i < end; i++, prev = cur) {
+		cur = fuzzy_class((unsigned char)s[i]);
+		if (j == qn || s[i] != q[j]) {
+			score += gap ? FUZZY_GAP : FUZZY_GAP_START;
+			gap = true;
+			run = 0;
+			first = 0;
+			continue;
+		}
+		if (prev == 0 && cur != 0) {
+			bonus = FUZZY_BOUNDARY;
+		} else if (prev != 2 && cur == 2) {
+			bonus = FUZZY_DIGIT;
+		} else {
+			bonus = cur == 0 ? FUZZY_BOUNDARY : 0;
+		}
+		/* a run keeps the bonus of the boundary it started on */
+		if (run > 0) {
+			if (bonus >= FUZZY_BOUNDARY && bonus > first) {
+				first = bonus;
+			}
+			bonus = MAX(MAX(bonus, first), FUZZY_RUN);
+		} else {
+			first = bonus;
+		}
+		score += FUZZY_MATCH + (j == 0 ? bonus * 2 : bonus);
+		gap = false;
+		run++;
+		j++;
+	}
+	return score;
+}
+
+bool
+hit_better(const struct hit *a, const struct hit *b)
+{
+	if (a->score != b->score) {
+		return a->score > b->score;
+	}
+	if (a->len != b->len) {
+		return a->len < b->len;
+	}
+	return a->pos < b->pos;
+}
+
+/* best first, for qsort */
+int
+hit_cmp(const void *a, const void *b)
+{
+	return hit_better(a, b) ? -1 : hit_better(b, a);
+}
+
+/* keep h if it is among the FUZZY_TOP best of the n in heap */
+void
+hit_push(struct hit *heap, size_t *n, struct hit h)
+{
+	size_t i, c;
+
+	if (*n < FUZZY_TOP) {
+		for (i = (*n)++; i > 0 && hit_better(&heap[(i - 1) / 2], &h);
+		    i = (i - 1) / 2) {
+			heap[i] = heap[(i - 1) / 2];
+		}
+		heap[i] = h;
+		return;
+	}
+	if (!hit_better(&h, &heap[0])) {
+		return;
+	}
+	/* sift the new worst down from the top */
+	for (i = 0; (c = 2 * i + 1) < *n; i = c) {
+		if (c + 1 < *n && hit_better(&heap[c], &heap[c + 1])) {
+			c++;
+		}
+		if (!hit_better(&h, &heap[c])) {
+			break;
+		}
+		heap[i] = heap[c];
+	}
+	heap[i] = h;
+}
+
+void
+rank_run(struct rank *r)
+{
+	const struct station_list *sl = r->sl;
+	const struct station *s;
+	const struct block *blk;
+	struct hit h;
+	size_t b, i, pos = r->pos, qn = strlen(r->q);
+
+	for (b = r->b0; b < r->b1; b++) {
+		blk = sl->blocks[b];
+		for (i = 0; i < blk->n; i++, pos++) {
+			s = &sl->stations[blk->ids[i]];
+			h.score = fuzzy_score(field_ptr(sl, s->key),
+			    s->key.len, r->q, qn);
+			if (h.score < 0) {
+				continue;
+			}
+			h.len = s->name.len;
+			h.pos = pos;
+			h.id = blk->ids[i];
+			hit_push(r->heap, &r->n, h);
+			r->matched++;
+		}
+	}
+}
+
+void *
+rank_work(void *arg)
+{
+	struct rank_pool *rp = arg;
+	struct rank *r;
+
+	pthread_mutex_lock(&rp->lock);
+	for (;;) {
+		while (rp->next >= rp->n && !rp->quit) {
+			pthread_cond_wait(&rp->go, &rp->lock);
+		}
+		if (rp->quit) {
+			break;
+		}
+		r = &rp->parts[rp->next++];
+		pthread_mutex_unlock(&rp->lock);
+		rank_run(r);
+		pthread_mutex_lock(&rp->lock);
+		if (++rp->finished == rp->n) {
+			pthread_cond_signal(&rp->done);
+		}
+	}
+	pthread_mutex_unlock(&rp->lock);
+	return NULL;
+}
+
+/* have n threads in the pool, as many as can be started */
+void
+rank_start(struct rank_pool *rp, size_t n)
+{
+	pthread_t *t;
+
+	if (rp->nthreads >= n) {
+		return;
+	}
+	t = realloc(rp->threads, sizeof(pthread_t) * n);
+	if (!t) {
+		return;
+	}
+	rp->threads = t;
+	while (rp->nthreads < n && pthread_create(&rp->threads[rp->nthreads],
+	    NULL, rank_work, rp) == 0) {
+		rp->nthreads++;
+	}
+}
+
+/* score the n parts, this thread taking its turn with the pool */
+void
+rank_round(struct rank_pool *rp, struct rank *parts, size_t n)
+{
+	struct rank *r;
+
+	pthread_mutex_lock(&rp->lock);
+	rp->parts = parts;
+	rp->n = n;
+	rp->next = 0;
+	rp->finished = 0;
+	pthread_cond_broadcast(&rp->go);
+	while (rp->next < n) {
+		r = &parts[rp->next++];
+		pthread_mutex_unlock(&rp->lock);
+		rank_run(r);
+		pthread_mutex_lock(&rp->lock);
+		rp->finished++;
+	}
+	while (rp->finished < n) {
+		pthread_cond_wait(&rp->done, &rp->lock);
+	}
+	rp->n = 0;
+	rp->next = 0;
+	pthread_mutex_unlock(&rp->lock);
+}
+
+void
+rank_stop(struct rank_pool *rp)
+{
+	size_t i;
+
+	pthread_mutex_lock(&rp->lock);
+	rp->quit = true;
+	pthread_cond_broadcast(&rp->go);
+	pthread_mutex_unlock(&rp->lock);
+	for (i = 0; i < rp->nthreads; i++) {
+		pthread_join(rp->threads[i], NULL);
+	}
+	free(rp->threads);
+	rp->threads = NULL;
+	rp->nthreads = 0;
+	rp->quit = false;
+}
+
+/*
+ * score every station against q, a slice of blocks at a time split into
+ * a share per core for the pool, and merge the best of each share into
+ * sl->fz; 1 if the search was cancelled first, leaving sl->fz as it was
+ */
+int
+fuzzy_rank(struct station_list *sl, const char *q)
+{
+	struct fuzzy *fz = &sl->fz;
+	struct rank *parts = NULL;
+	struct hit *heap = NULL;
+	size_t i, n, b, b1, step, m = 0, matched = 0;
+	long ncpu;
+	char fq[sizeof(fz->q)];
+	int rv = -1;
+
+	if (strcmp(fz->q, q) == 0 && fz->size == sl->size
+	    && fz->edit_gen == sl->edit_gen) {
+		return 0;
+	}
+	key_fold(fq, sizeof(fq), q, strlen(q));
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	n = MIN(sl->size / FUZZY_PART, sl->nblocks);
+	n = MAX(MIN(n, (size_t)MAX(ncpu, 1)), 1);
+	heap = malloc(sizeof(struct hit) * n * FUZZY_TOP);
+	parts = calloc(n, sizeof(struct rank));
+	if (!heap || !parts) {
+		goto done;
+	}
+	for (i = 0; i < n; i++) {
+		parts[i].sl = sl;
+		parts[i].q = fq;
+		parts[i].heap = heap + i * FUZZY_TOP;
+	}
+	rank_start(&fz->workers, n - 1);
+	/* a share of about SEARCH_SLICE stations per thread */
+	step = MAX(n * SEARCH_SLICE / BLOCK_SZ, 1);
+	for (b = 0; b < sl->nblocks; b = b1) {
+		b1 = MIN(b + step, sl->nblocks);
+		for (i = 0; i < n; i++) {
+			parts[i].b0 = b + i * (b1 - b) / n;
+			parts[i].b1 = b + (i + 1) * (b1 - b) / n;
+			parts[i].pos = fen_sum(sl, parts[i].b0);
+		}
+		rank_round(&fz->workers, parts, n);
+		if (!search_yield(sl, fen_sum(sl, b1), sl->size)) {
+			rv = 1;
+			goto done;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		memmove(heap + m, parts[i].heap,
+		    sizeof(struct hit) * parts[i].n);
+		m += parts[i].n;
+		matched += parts[i].matched;
+	}
+	qsort(heap, m, sizeof(struct hit), hit_cmp);
+	free(fz->hits);
+	fz->hits = heap;
+	fz->a = n * FUZZY_TOP;
+	heap = NULL;
+	strcpy_t(fz->q, q, sizeof(fz->q));
+	fz->size = sl->size;
+	fz->edit_gen = sl->edit_gen;
+	fz->n = MIN(m, FUZZY_TOP);
+	fz->matched = matched;
+	fz->row = 0;
+	fz->pg = 0;
+	rv = 0;
+done:
+	free(heap);
+	free(parts);
+	return rv;
+}
+
+/* have the ranked view follow q, ranking it in the background */
+void
+fuzzy_sync(struct station_list *sl, const char *q)
+{
+	struct fuzzy *fz = &sl->fz;
+
+	if (strcmp(fz->q, q) == 0 && fz->size == sl->size
+	    && fz->edit_gen == sl->edit_gen) {
+		search_cancel(sl);
+	} else if (q[0] && sl->nblocks > 0) {
+		search_want(sl, JOB_FUZZY, q, THEN_NONE);
+	} else {
+		search_cancel(sl);
+		strcpy_t(fz->q, q, sizeof(fz->q));
+		fz->size = sl->size;
+		fz->edit_gen = sl->edit_gen;
+		fz->n = 0;
+		fz->matched = 0;
+		fz->row = 0;
+		fz->pg = 0;
+	}
+}
+
+/* move to the next match for cmd after the cursor, once they are found */
+void
+search_f(struct station_list *sl, const char *cmd)
 {
-	struct station *s = NULL;
-	int i;
+	size_t *ids, n, k, i;
+	int h = tb_height();
 
-	if (index >= sl->a_size - 1 || sl->size == 0) {
-		return -1;
-	}
-	s = sl->stations[index];
-	for (i = index; i < sl->size - 1; i++) {
-		sl->stations[i] = sl->stations[i + 1];
+	if (!cmd[0]) {
+		return;
 	}
-	free(s->name);
-	s->name = NULL;
-	free(s->url);
-	s->url = NULL;
-	free(s);
-	s = NULL;
-	i = sl->size - 1;
-	if (sl->stations[i]) {
-		sl->stations[i] = NULL;
+	ids = search_top(sl, cmd, &n);
+	if (!ids) {
+		search_want(sl, JOB_NARROW, cmd, THEN_NEXT);
+		return;
 	}
-	if (sl->index == i && sl->index > 0) {
-		sl->index -= 1;
+	search_cancel(sl);
+	search_keep(sl, cmd);
+	k = seq_rank(sl, ids, n, sl->index + 1);
+	if (k < n) {
+		i = seq_pos(sl, ids[k]);
+		sl->index = i;
+		if (i > (sl->pg_i + (h - 1))) {
+			sl->pg_i = i;
+		}
 	}
-	sl->size = i;
-	return 0;
 }
 
-int
-station_list_save(const struct station_list *sl)
+/* move to the match for cmd before the cursor, once they are found */
+void
+search_r(struct station_list *sl, const char *cmd)
 {
-	FILE *save = NULL;
-	size_t i, s;
-	char *bpath = NULL;
+	size_t *ids, n, k, i;
 
-	s = strlen(sl->path) + 5;
-	bpath = malloc(sizeof(char) * s);
-	if (!bpath) {
-		goto error;
-	}
-	snprintf(bpath, s, "%s.bak", sl->path);
-	save = fopen(bpath, "w+");
-	if (!save) {
-		printf("Failed to open tmp file: %s\n", bpath);
-		goto error;
+	if (!cmd[0]) {
+		return;
 	}
-	for (i = 0; i < sl->size; i++) {
-		fprintf(save, "\"%s\" \"%s\"\n", sl->stations[i]->name,
-		    sl->stations[i]->url);
-	}
-	fclose(save);
-	save = NULL;
-	if (rename(bpath, sl->path) != 0) {
-		printf("Failed to replace stations file %s\n", sl->path);
-		goto error;
+	ids = search_top(sl, cmd, &n);
+	if (!ids) {
+		search_want(sl, JOB_NARROW, cmd, THEN_PREV);
+		return;
 	}
-	return 0;
-error:
-	free(bpath);
-	bpath = NULL;
-	if (save != NULL) {
-		fclose(save);
-		save = NULL;
+	search_cancel(sl);
+	search_keep(sl, cmd);
+	k = seq_rank(sl, ids, n, sl->index);
+	if (k > 0) {
+		i = seq_pos(sl, ids[k - 1]);
+		sl->index = i;
+		if (i < sl->pg_i) {
+			sl->pg_i = i;
+		}
 	}
-	return -1;
 }
 
-int
-player_init(struct player *pl)
+/*
+ * lock the list ahead of the search worker, which hands the lock over
+ * between slices while anyone is waiting for it
+ */
+void
+list_lock(struct station_list *sl)
 {
-	pl->vol = 100;
-	pl->muted = 0;
-	pl->paused = 0;
-	pl->cur_station = "";
-	pl->cmd[0] = '\0';
-	pl->msg[0] = '\0';
-	pl->ctx = mpv_create();
-	if (!pl->ctx) {
-		printf("Failed to create mpv context\n");
-		return -1;
-	}
-	if (mpv_initialize(pl->ctx) < 0) {
-		printf("Failed to initialize MPV\n");
-		return -1;
-	}
-	return 0;
+	struct search *sr = &sl->srch;
+
+	pthread_mutex_lock(&sr->lock);
+	sr->want++;
+	pthread_mutex_unlock(&sr->lock);
+	pthread_mutex_lock(&sl->lock);
+	pthread_mutex_lock(&sr->lock);
+	sr->want--;
+	pthread_cond_broadcast(&sr->turn);
+	pthread_mutex_unlock(&sr->lock);
 }
 
-int
-vol_add(struct player *pl)
+/*
+ * note progress, and give the list lock to whoever waits for it; whether
+ * the job is still wanted, over the same list
+ */
+bool
+search_yield(struct station_list *sl, size_t pos, size_t total)
 {
-	if (pl->vol < 100) {
-		if (mpv_command_string(pl->ctx, "add volume 1") < 0) {
-			strcpy_t(pl->msg, "mpv api error", sizeof(pl->msg));
-			return -1;
+	struct search *sr = &sl->srch;
+	unsigned long seq = sr->seq, gen = sl->gen;
+	size_t size = sl->size;
+
+	sr->pos = pos;
+	sr->total = total;
+	pthread_mutex_lock(&sr->lock);
+	if (sr->want > 0) {
+		pthread_mutex_unlock(&sl->lock);
+		while (sr->want > 0) {
+			pthread_cond_wait(&sr->turn, &sr->lock);
 		}
-		pl->msg[0] = '\0';
-		pl->vol += 1;
+		pthread_mutex_unlock(&sr->lock);
+		pthread_mutex_lock(&sl->lock);
+	} else {
+		pthread_mutex_unlock(&sr->lock);
 	}
-	return 0;
+	return !sr->quit && sr->seq == seq && sl->gen == gen
+	    && sl->size == size;
 }
 
-int
-vol_mute(struct player *pl)
+/*
+ * run the job last asked for, from the start again whenever the list
+ * changes under it, until it is done or cancelled
+ */
+void
+search_job(struct station_list *sl)
 {
-	if (mpv_command_string(pl->ctx, "cycle mute") >= 0) {
-		pl->muted = 1 - pl->muted;
-		return 0;
+	struct search *sr = &sl->srch;
+	unsigned long seq = sr->seq;
+	enum job job = sr->job;
+	char q[sizeof(sr->q)];
+	int rv;
+
+	strcpy_t(q, sr->q, sizeof(q));
+	sr->busy = true;
+	do {
+		sr->pos = 0;
+		sr->total = 0;
+		rv = job == JOB_FUZZY ? fuzzy_rank(sl, q) : narrow_sync(sl, q);
+	} while (rv > 0 && !sr->quit && sr->seq == seq);
+	sr->busy = false;
+	if (sr->seq == seq) {
+		sr->done = seq;
+		sr->failed = rv < 0;
+		list_wake(sl);
 	}
-	return -1;
 }
 
-int
-vol_sub(struct player *pl)
+/* search worker: sleeps on the list lock until there is a job */
+void *
+search_run(void *arg)
 {
-	if (pl->vol > 0) {
-		if (mpv_command_string(pl->ctx, "add volume -1") < 0) {
-			strcpy_t(pl->msg, "mpv api error", sizeof(pl->msg));
-			return -1;
+	struct station_list *sl = arg;
+	struct search *sr = &sl->srch;
+
+	pthread_mutex_lock(&sl->lock);
+	for (;;) {
+		while (!sr->quit && sr->done == sr->seq) {
+			pthread_cond_wait(&sr->wake, &sl->lock);
 		}
-		pl->msg[0] = '\0';
-		pl->vol -= 1;
+		if (sr->quit) {
+			break;
+		}
+		search_job(sl);
 	}
-	return 0;
+	pthread_mutex_unlock(&sl->lock);
+	return NULL;
 }
 
-int
-stop(struct player *pl)
+/*
+ * have the worker run job for q in place of whatever it is on, unless
+ * that is the same; then is the move to make once it is done
+ */
+void
+search_want(struct station_list *sl, enum job job, const char *q,
+    enum then then)
 {
-	if (mpv_command_string(pl->ctx, "cycle pause") < 0) {
-		strcpy_t(pl->msg, "mpv api error", sizeof(pl->msg));
-		return -1;
+	struct search *sr = &sl->srch;
+
+	sr->then = then;
+	if (sr->job == job && strcmp(sr->q, q) == 0 && sr->gen == sl->gen
+	    && sr->size == sl->size) {
+		return;
+	}
+	sr->job = job;
+	strcpy_t(sr->q, q, sizeof(sr->q));
+	sr->gen = sl->gen;
+	sr->size = sl->size;
+	sr->seq++;
+	sr->pos = 0;
+	sr->total = 0;
+	if (!sr->started
+	    && pthread_create(&sr->thread, NULL, search_run, sl) == 0) {
+		sr->started = true;
+	}
+	/* without a worker the search is done here and now */
+	if (sr->started) {
+		pthread_cond_signal(&sr->wake);
+	} else {
+		search_job(sl);
 	}
-	pl->paused = 1 - pl->paused;
-	return 0;
 }
 
-int
-play(struct player *pl, struct station s)
+/* drop the job under way, if any; the worker lets go of it within a slice */
+void
+search_cancel(struct station_list *sl)
 {
-	const char *cmd[] = {"loadfile", s.url, NULL};
+	struct search *sr = &sl->srch;
 
-	if (mpv_command(pl->ctx, cmd) < 0) {
-		strcpy_t(pl->msg, "Failed to play URL", sizeof(pl->msg));
-		return -1;
+	if (sr->job == JOB_NONE || sr->done == sr->seq) {
+		return;
 	}
-	pl->msg[0] = '\0';
-	pl->cur_station = s.name;
-	return 0;
+	sr->job = JOB_NONE;
+	sr->seq++;
+	sr->done = sr->seq;
+	sr->seen = sr->seq;
 }
 
-int
-parse_stations(struct station_list *sl, FILE *stream)
+/* cancel any job and wait for the worker to exit */
+void
+search_stop(struct station_list *sl)
 {
-	struct station *s = NULL;
-	size_t i = 0, len, fbuf_sz, fbuf_i = 0, buf_sz = 2048;
-	bool quote_open = false, step = false, esc = false;
-	char *fbuf, *buf = malloc(sizeof(char) * 2048), tmp;
-	void *a_tmp;
+	struct search *sr = &sl->srch;
 
-	if (!buf) {
-		printf("Failed to allocate parse buffer\n");
-		return -1;
+	search_cancel(sl);
+	if (!sr->started) {
+		return;
 	}
+	sr->quit = true;
+	pthread_cond_signal(&sr->wake);
+	pthread_mutex_unlock(&sl->lock);
+	pthread_join(sr->thread, NULL);
+	pthread_mutex_lock(&sl->lock);
+	sr->started = false;
+}
 
-	if (fseek(stream, 0L, SEEK_END) != 0) {
-		goto error;
-	}
-	fbuf_sz = ftell(stream);
-	if (fbuf_sz == -1) {
-		goto error;
+/* report a job the worker has finished, and make the move it was for */
+void
+search_poll(struct station_list *sl, struct player *pl)
+{
+	struct search *sr = &sl->srch;
+
+	if (sr->job == JOB_NONE || sr->done != sr->seq
+	    || sr->seen == sr->seq) {
+		return;
 	}
-	if (fseek(stream, 0L, SEEK_SET) != 0) {
-		goto error;
+	sr->seen = sr->seq;
+	if (sr->failed) {
+		strcpy_t(pl->msg, "Failed to search", sizeof(pl->msg));
+		return;
 	}
-	fbuf = malloc(sizeof(char) * (fbuf_sz + 1));
-	len = fread(fbuf, sizeof(char), fbuf_sz, stream);
-	if (ferror(stream) != 0) {
-		goto error;
+	/* moves are for the query still being shown */
+	if (sr->job != JOB_NARROW || strcmp(sr->q, pl->cmd) != 0
+	    || (sl->state != NORMAL && sl->state != SEARCH)) {
+		return;
 	}
-	fbuf[len] = '\0';
-
-	for (tmp = fbuf[fbuf_i]; fbuf_i < len; tmp = fbuf[++fbuf_i]) {
-		if (!quote_open) {
-			if (tmp != ' ' && tmp != '\"' && tmp != '\n') {
-				printf("Missing quote\n");
-				goto error;
-			} else if (tmp == '\"') {
-				quote_open = true;
-				if (step == false) {
-					s = malloc(sizeof(struct station));
-					if (!s) {
-						printf("Allocation failed\n");
-						goto error;
-					}
-					s->name = NULL;
-					s->url = NULL;
-				}
-			}
-		} else {
-			switch (tmp) {
-			case '\n':
-				printf("Unexpected end of line\n");
-				goto error;
-				break;
-			case '\\':
-				esc = true;
-				break;
-			case '\"':
-				if (esc) {
-					esc = false;
-					goto esc;
-				}
-				quote_open = false;
-				if (i == buf_sz) {
-					a_tmp = realloc(buf, buf_sz + 1024);
-					if (a_tmp != NULL) {
-						buf = a_tmp;
-						buf_sz += 1024;
-					} else {
-						goto error;
-					}
-				}
-				buf[i++] = '\0';
-				if (step == false) {
-					s->name = strdup(buf);
-					step = true;
-				} else {
-					s->url = strdup(buf);
-					station_list_add(sl, s);
-					step = false;
-				}
-				i = 0;
-				memset(buf, 0, buf_sz);
-				break;
-			default:
-esc:
-				if (i < buf_sz) {
-					buf[i++] = tmp;
-				} else {
-					a_tmp = realloc(buf, buf_sz + 1024);
-					if (a_tmp != NULL) {
-						buf = a_tmp;
-						buf_sz += 1024;
-					}
-					goto error;
-				}
-				break;
-			}
-		}
+	/* entered before its matches were in */
+	if (sl->state == NORMAL && sr->then == THEN_INC) {
+		search_keep(sl, pl->cmd);
 	}
-	free(buf);
-	buf = NULL;
-	return 0;
-error:
-	printf("Failed to read stations file\n");
-	fclose(stream);
-	free(buf);
-	buf = NULL;
-	free(s->name);
-	s->name = NULL;
-	free(s->url);
-	s->url = NULL;
-	free(s);
-	s = NULL;
-	return -1;
-}
-
-int
-search_f(struct station_list *sl, const char *cmd)
-{
-	size_t i;
-	int h = tb_height();
-
-	if (sl->index + 1 < h - 1) {
-		for (i = sl->index + 1; i < sl->size; i++) {
-			if (strstr_i(sl->stations[i]->name, cmd) != NULL) {
-				sl->index = i;
-				if (i > (sl->pg_i + (h - 1))) {
-					sl->pg_i = i;
-				}
-				break;
-			}
-		}
+	switch (sr->then) {
+	case THEN_INC:
+		search_inc(sl, pl->cmd);
+		break;
+	case THEN_NEXT:
+		search_f(sl, pl->cmd);
+		break;
+	case THEN_PREV:
+		search_r(sl, pl->cmd);
+		break;
+	default:
+		break;
 	}
-	return 0;
 }
 
+/* size the record of the screen for w by h, to be drawn whole */
 int
-search_r(struct station_list *sl, const char *cmd)
+screen_fit(struct screen *scr, int w, int h)
 {
-	size_t i;
+	void *a_tmp;
 
-	if (sl->index == 0) {
+	if (scr->rows && scr->w == w && scr->h == h) {
 		return 0;
 	}
-	for (i = sl->index - 1;; i--) {
-		if (strstr_i(sl->stations[i]->name, cmd) != NULL) {
-			sl->index = i;
-			if (i < sl->pg_i) {
-				sl->pg_i = i;
-			}
-			break;
-		}
-		if (i == 0) {
-			break;
-		}
+	scr->ok = false;
+	scr->w = 0;
+	scr->h = 0;
+	a_tmp = realloc(scr->rows, sizeof(struct shown) * h);
+	if (!a_tmp) {
+		return -1;
+	}
+	scr->rows = a_tmp;
+	a_tmp = realloc(scr->bar, w + 1);
+	if (!a_tmp) {
+		return -1;
 	}
+	scr->bar = a_tmp;
+	scr->w = w;
+	scr->h = h;
 	return 0;
 }
 
 void
 station_list_render(struct station_list *sl, struct player *pl)
 {
-	size_t i, j, l, r_w;
-	int c = 0, h = tb_height(), w = tb_width();
-	char *title = NULL;
+	struct filter *ft = &sl->filt;
+	struct screen *scr = &sl->scr;
+	struct shown sh;
+	size_t i, j, k, l, r_w, first, cur = 0, *ids, n;
+	bool ranked = sl->state == FUZZY && pl->cmd[0], fit;
+	int c, h = tb_height(), w = tb_width();
 	char bar[w];
+	char row[w * 4 + 1];
 	char muted[4];
 	char playing[8];
+	char loading[48];
+	char filter[48];
+	char match[64];
+	char fuzzy[48];
+	char busy[32];
 
-	tb_clear();
+	/* rows kept from the last frame are drawn again only if changed */
+	fit = screen_fit(scr, w, h) == 0;
+	if (!fit || scr->gen != sl->gen) {
+		scr->ok = false;
+	}
+	if (!scr->ok) {
+		tb_clear();
+	}
 
 	if (sl->index > sl->pg_i) {
 		if (sl->index - sl->pg_i > (h - 2)) {
@@ -492,54 +5806,200 @@ station_list_render(struct station_list *sl, struct player *pl)
 		sl->pg_i -= 1;
 	}
 
-	mpv_get_property(pl->ctx, "media-title", MPV_FORMAT_OSD_STRING,
-	    &title);
 	strcpy_t(muted, pl->muted ? "(m)" : "", sizeof(muted));
 	strcpy_t(playing, pl->paused ? "Paused" : "Playing", sizeof(playing));
+	loading[0] = '\0';
+	if (sl->loading) {
+		/* total is extrapolated from the share of the file parsed */
+		snprintf(loading, sizeof(loading), "loading %zu/%zu | ",
+		    sl->size, sl->load_pos ? (size_t)((double)sl->size
+		    * sl->map_sz / sl->load_pos) : 0);
+	}
+
+	filter[0] = '\0';
+	if (ft->on) {
+		snprintf(filter, sizeof(filter), "Filter: %zu%s | ", ft->n,
+		    ft->next < sl->size ? "+" : "");
+	}
+	fuzzy[0] = '\0';
+	if (sl->state == FUZZY) {
+		snprintf(fuzzy, sizeof(fuzzy), "Fuzzy: %zu | ",
+		    sl->fz.matched);
+	}
+	busy[0] = '\0';
+	if (sl->srch.job != JOB_NONE && sl->srch.done != sl->srch.seq) {
+		snprintf(busy, sizeof(busy), "Searching %zu%% | ",
+		    sl->srch.total ? sl->srch.pos * 100 / sl->srch.total : 0);
+	}
+	match[0] = '\0';
+	ids = sl->state == NORMAL || sl->state == SEARCH
+	    ? narrow_top(sl, pl->cmd, &n) : NULL;
+	if (ids) {
+		k = seq_rank(sl, ids, n, sl->index);
+		if (k < n && seq_pos(sl, ids[k]) == sl->index) {
+			snprintf(match, sizeof(match), "Match %zu of %zu | ",
+			    k + 1, n);
+		} else {
+			snprintf(match, sizeof(match), "%zu matches | ", n);
+		}
+	}
 
 	/* fix later */
-	snprintf(bar, sizeof(bar), "Vol: %d%s | %s: %s | %s | %s %s",
-	    pl->vol, muted, playing, pl->cur_station, title, pl->msg, pl->cmd);
-	tb_print(0, h - 1, 0, 3, bar);
+	snprintf(bar, sizeof(bar),
+	    "%s%s%s%s%sVol: %d%s | %s: %s | %s | %s %s",
+	    loading, filter, busy, match, fuzzy, pl->vol, muted, playing,
+	    pl->cur_station, pl->title, pl->msg, pl->cmd);
+	if (!scr->ok || strcmp(scr->bar, bar) != 0) {
+		tb_print_ex(0, h - 1, 0, 3, &r_w, bar);
+		for (j = r_w; j < w; j++) {
+			tb_set_cell(j, h - 1, ' ', 0, 0);
+		}
+		if (fit) {
+			strcpy_t(scr->bar, bar, w + 1);
+		}
+	}
 
-	l = MIN(sl->size, sl->pg_i + h - 1);
+	if (ranked) {
+		if (sl->fz.row < sl->fz.pg) {
+			sl->fz.pg = sl->fz.row;
+		} else if (sl->fz.row - sl->fz.pg > (h - 2)) {
+			sl->fz.pg = sl->fz.row - (h - 2);
+		}
+		first = sl->fz.pg;
+		l = MIN(sl->fz.n, sl->fz.pg + h - 1);
+	} else if (ft->on) {
+		/* keep the row of the cursor on screen */
+		k = seq_rank(sl, ft->ids, ft->n, sl->index);
+		if (k < ft->pg) {
+			ft->pg = k;
+		} else if (k < ft->n && k - ft->pg > (h - 2)) {
+			ft->pg = k - (h - 2);
+		}
+		if (sl->index < sl->size) {
+			cur = *seq_ref(sl, sl->index);
+		}
+		first = ft->pg;
+		l = MIN(ft->n, ft->pg + h - 1);
+	} else {
+		first = sl->pg_i;
+		l = MIN(sl->size, sl->pg_i + h - 1);
+	}
 
-	for (i = sl->pg_i; i < l; i++) {
-		if (i == sl->index) {
-			tb_print_ex(0, c++, 1, 8, &r_w, sl->stations[i]->name);
+	for (c = 0, i = first; c < h - 1; c++, i++) {
+		sh.id = SIZE_MAX;
+		sh.hl = false;
+		if (i < l && ranked) {
+			sh.id = sl->fz.hits[i].id;
+			sh.hl = i == sl->fz.row;
+		} else if (i < l && ft->on) {
+			/* a station deleted since is left blank */
+			if (sl->owner[ft->ids[i]]) {
+				sh.id = ft->ids[i];
+				sh.hl = sl->index < sl->size
+				    && ft->ids[i] == cur;
+			}
+		} else if (i < l) {
+			sh.id = *seq_ref(sl, i);
+			sh.hl = i == sl->index;
+		}
+		if (scr->ok && scr->rows[c].id == sh.id
+		    && scr->rows[c].hl == sh.hl) {
+			continue;
+		}
+		if (fit) {
+			scr->rows[c] = sh;
+		}
+		if (sh.id == SIZE_MAX) {
+			for (j = 0; j < w; j++) {
+				tb_set_cell(j, c, ' ', 0, 0);
+			}
+			continue;
+		}
+		field_copy(sl, sl->stations[sh.id].name, row, sizeof(row));
+		if (sh.hl) {
+			tb_print_ex(0, c, 1, 8, &r_w, row);
 		} else {
-			tb_print_ex(0, c++, 0, 0, &r_w, sl->stations[i]->name);
+			tb_print_ex(0, c, 0, 0, &r_w, row);
 		}
 		for (j = r_w; j < w; j++) {
-			tb_set_cell(j, c - 1, ' ', 1, 0);
-		}
-	}
-	/*
-	for (i = c; i < h - 1; i++) {
-		for (j = 0; j < w; j++) {
 			tb_set_cell(j, c, ' ', 1, 0);
 		}
 	}
-	*/
+	scr->ok = fit;
+	scr->gen = sl->gen;
 	tb_present();
-	if (title != NULL) {
-		mpv_free(title);
-		title = NULL;
+}
+
+/*
+ * sleep until a key, a resize, mpv or another thread wakes the ui, or
+ * for timeout ms (-1 for ever), then handle what came; true if the
+ * screen is to be drawn again
+ */
+bool
+io_read(struct station_list *sl, struct player *pl, int timeout)
+{
+	struct pollfd fds[3];
+	struct tb_event ev;
+	char buf[64];
+	bool woke = false;
+	int i, n = 0;
+
+	tb_get_fds(&fds[0].fd, &fds[1].fd);
+	fds[2].fd = sl->wake[0];
+	for (i = 0; i < 3; i++) {
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+	poll(fds, 3, timeout);
+	if (fds[2].revents & POLLIN) {
+		while (read(sl->wake[0], buf, sizeof(buf)) > 0)
+			;
+		player_events(pl);
+		woke = true;
+	}
+	list_lock(sl);
+	/* termbox reads the tty and its resize pipe, maybe several keys */
+	while (tb_peek_event(&ev, 0) == TB_OK) {
+		io_handle(sl, pl, &ev);
+		n++;
 	}
+	/* without a key a search still catches up with the list */
+	if (n == 0) {
+		memset(&ev, 0, sizeof(ev));
+		io_handle(sl, pl, &ev);
+	}
+	pthread_mutex_unlock(&sl->lock);
+	return n > 0 || woke;
 }
 
 int
-io_read(struct station_list *sl, struct player *pl)
+io_handle(struct station_list *sl, struct player *pl,
+    const struct tb_event *ev)
 {
 	struct station *s = NULL;
-	struct tb_event ev;
+	struct field name, url;
 	size_t i;
-	int h = tb_height();
-	char buf[2048];
+	int n, h = tb_height();
+	char ch[8];
 
-	tb_peek_event(&ev, 100);
+	/* the loader only appends, edits wait until it is done */
+	if (sl->loading && sl->state == NORMAL && ev->ch && ev->ch < 0x80
+	    && strchr("aepx", ev->ch)) {
+		strcpy_t(pl->msg, "Still loading", sizeof(pl->msg));
+		return 0;
+	}
+	/* escape also stops a search n or N is waiting on */
+	if (sl->state == NORMAL && ev->key == ESC) {
+		search_cancel(sl);
+		return 0;
+	}
+	if (sl->state == NORMAL && sl->filt.on && ev->ch && ev->ch < 0x80
+	    && strchr("gGjk", ev->ch)) {
+		filter_move(sl, ev->ch);
+		return 0;
+	}
 	if (sl->state == NORMAL) {
-		switch (ev.ch) {
+		switch (ev->ch) {
 		case '0':
 			vol_add(pl);
 			break;
@@ -550,25 +6010,45 @@ io_read(struct station_list *sl, struct player *pl)
 			stop(pl);
 			break;
 		case 'a':
-			s = malloc(sizeof(struct station));
-			if (!s) {
-				printf("Allocation failed\n");
+			if (pool_add(&sl->pool, "<name>", 6, &name) < 0
+			    || pool_add(&sl->pool, "<url>", 5, &url) < 0
+			    || station_list_add(sl, name, url, NULL) < 0) {
 				return -1;
 			}
-			s->name = strdup("<name>");
-			s->url = strdup("<url>");
-			station_list_add(sl, s);
+			if (journal_append(sl, J_ADD, 6, 5, "<name>", 6,
+			    "<url>", 5) < 0) {
+				strcpy_t(pl->msg, "Failed to write journal",
+				    sizeof(pl->msg));
+			}
 			sl->index = sl->size - 1;
 			pl->cmd[0] = '\0';
 			sl->state = EDIT_N;
 		case 'e':
-			if (!sl->stations[sl->index]) {
+			if (sl->index >= sl->size) {
 				break;
 			}
-			strcpy_t(pl->cmd, sl->stations[sl->index]->name,
+			field_copy(sl, station_at(sl, sl->index)->name, pl->cmd,
 			    sizeof(pl->cmd));
 			sl->state = EDIT_N;
 			break;
+		case 'f':
+			if (sl->filt.on) {
+				sl->filt.on = false;
+				sl->pg_i = sl->index;
+			} else if (pl->cmd[0]) {
+				filter_start(sl, pl->cmd);
+			} else {
+				strcpy_t(pl->msg, "No search to filter by",
+				    sizeof(pl->msg));
+			}
+			break;
+		case 'F':
+			pl->cmd[0] = '\0';
+			sl->fz.q[0] = '\0';
+			sl->fz.n = 0;
+			sl->fz.matched = 0;
+			sl->state = FUZZY;
+			break;
 		case 'g':
 			sl->index = 0;
 			sl->pg_i = 0;
@@ -592,8 +6072,9 @@ io_read(struct station_list *sl, struct player *pl)
 			}
 			break;
 		case 'l':
-			if (sl->stations[sl->index]) {
-				play(pl, *sl->stations[sl->index]);
+			if (sl->index < sl->size) {
+				s = station_at(sl, sl->index);
+				play(pl, sl, s);
 			}
 			break;
 		case 'm':
@@ -606,32 +6087,59 @@ io_read(struct station_list *sl, struct player *pl)
 			search_r(sl, pl->cmd);
 			break;
 		case 'p':
-			if (sl->sel) {
-				station_list_swap(sl, *sl->sel, sl->index);
+			if (sl->sel && *sl->sel < sl->size) {
+				i = *sl->sel;
+				if (station_list_swap(sl, i, sl->index) == 0
+				    && journal_append(sl, J_SWAP, i, sl->index,
+				    NULL, 0, NULL, 0) < 0) {
+					strcpy_t(pl->msg,
+					    "Failed to write journal",
+					    sizeof(pl->msg));
+				}
 			}
 			break;
 		case 'q':
 			tb_shutdown();
-			station_list_save(sl);
-			for (i = 0; i < sl->size; i++) {
-				free(sl->stations[i]->name);
-				free(sl->stations[i]->url);
-				free(sl->stations[i]);
+			search_stop(sl);
+			if (sl->loading) {
+				pthread_mutex_unlock(&sl->lock);
+				pthread_join(sl->loader, NULL);
+				pthread_mutex_lock(&sl->lock);
+			}
+			if (sl->err[0]) {
+				printf("%s\nFailed to read stations\n",
+				    sl->err);
+				exit(-1);
+			}
+			if (sl->snap) {
+				pthread_mutex_unlock(&sl->lock);
+				pthread_join(sl->compactor, NULL);
+				pthread_mutex_lock(&sl->lock);
+				compact_finish(sl);
+			}
+			/* edits are already in the journal */
+			if (sl->jfd < 0) {
+				station_list_save(sl);
+			} else {
+				close(sl->jfd);
 			}
+			station_list_free(sl);
 			exit(0);
 			break;
 		case 'R':
 			tb_shutdown();
 			tb_init();
+			/* the new back buffer is blank */
+			sl->scr.ok = false;
 			break;
 		case 'x':
-			if (sl->sel) {
-				if (*sl->sel == sl->index) {
-					free(sl->sel);
-					sl->sel = NULL;
-				}
+			i = sl->index;
+			if (station_list_delete(sl, i) == 0
+			    && journal_append(sl, J_DEL, i, 0, NULL, 0, NULL,
+			    0) < 0) {
+				strcpy_t(pl->msg, "Failed to write journal",
+				    sizeof(pl->msg));
 			}
-			station_list_delete(sl, sl->index);
 			break;
 		case 'y':
 			if (!sl->sel) {
@@ -645,50 +6153,104 @@ io_read(struct station_list *sl, struct player *pl)
 			break;
 		case '/':
 			memset(pl->cmd, '\0', strlen(pl->cmd));
+			sl->nar.from = sl->index;
+			sl->nar.from_pg = sl->pg_i;
 			sl->state = SEARCH;
 			break;
 		default:
 			break;
 		}
 	} else {
-		switch (ev.key) {
+		switch (ev->key) {
 		case BACKSPACE:
+			/* a whole character, with its continuation bytes */
 			i = strlen(pl->cmd);
+			while (i > 0 && (pl->cmd[i - 1] & 0xc0) == 0x80) {
+				i--;
+			}
 			if (i > 0) {
 				pl->cmd[i - 1] = '\0';
 			}
 			break;
+		case TB_KEY_ARROW_DOWN:
+		case TB_KEY_CTRL_N:
+			if (sl->state == FUZZY && sl->fz.row + 1 < sl->fz.n) {
+				sl->fz.row++;
+			}
+			break;
+		case TB_KEY_ARROW_UP:
+		case TB_KEY_CTRL_P:
+			if (sl->state == FUZZY && sl->fz.row > 0) {
+				sl->fz.row--;
+			}
+			break;
 		case ESC:
 			memset(pl->cmd, 0, strlen(pl->cmd));
+			search_cancel(sl);
+			if (sl->state == SEARCH) {
+				sl->index = sl->nar.from;
+				sl->pg_i = sl->nar.from_pg;
+			}
 			sl->state = NORMAL;
 			break;
 		case ENTER:
-			if (sl->state == SEARCH) {
-				search_f(sl, pl->cmd);
+			if (sl->state == FUZZY) {
+				if (sl->fz.n > 0) {
+					sl->index = seq_pos(sl,
+					    sl->fz.hits[sl->fz.row].id);
+					sl->pg_i = sl->index;
+				}
+				pl->cmd[0] = '\0';
+				sl->state = NORMAL;
+			} else if (sl->state == SEARCH) {
+				/* it has already moved to its match */
+				if (sl->filt.on && pl->cmd[0]) {
+					filter_start(sl, pl->cmd);
+				}
+				search_keep(sl, pl->cmd);
 				sl->state = NORMAL;
 			} else {
+				s = station_at(sl, sl->index);
+				if (station_list_edit(sl, sl->index,
+				    sl->state == EDIT_U, pl->cmd,
+				    strlen(pl->cmd)) < 0) {
+					strcpy_t(pl->msg,
+					    "Failed to edit station",
+					    sizeof(pl->msg));
+				} else if (journal_append(sl, sl->state
+				    == EDIT_N ? J_NAME : J_URL, sl->index, 0,
+				    pl->cmd, strlen(pl->cmd), NULL, 0) < 0) {
+					strcpy_t(pl->msg,
+					    "Failed to write journal",
+					    sizeof(pl->msg));
+				}
 				if (sl->state == EDIT_N) {
-					free(sl->stations[sl->index]->name);
-					sl->stations[sl->index]->name =
-					    strdup(pl->cmd);
-					strcpy_t(pl->cmd,
-					    sl->stations[sl->index]->url,
+					field_copy(sl, s->url, pl->cmd,
 					    sizeof(pl->cmd));
 					sl->state = EDIT_U;
 				} else {
-					free(sl->stations[sl->index]->url);
-					sl->stations[sl->index]->url =
-					    strdup(pl->cmd);
 					pl->cmd[0] = '\0';
 					sl->state = NORMAL;
 				}
 			}
 			break;
 		default:
-			snprintf(buf, sizeof(buf), "%s%c", pl->cmd, ev.ch);
-			strcpy_t(pl->cmd, buf, sizeof(pl->cmd));
+			if (!ev->ch) {
+				break;
+			}
+			n = tb_utf8_unicode_to_char(ch, ev->ch);
+			i = strlen(pl->cmd);
+			if (i + n < sizeof(pl->cmd)) {
+				memcpy(pl->cmd + i, ch, n);
+				pl->cmd[i + n] = '\0';
+			}
 			break;
 		}
+		if (sl->state == SEARCH) {
+			search_inc(sl, pl->cmd);
+		} else if (sl->state == FUZZY) {
+			fuzzy_sync(sl, pl->cmd);
+		}
 	}
 	return 0;
 }
@@ -700,10 +6262,16 @@ main(int argc, char *argv[])
 	struct player pl;
 	struct station_list sl;
 	char path[4096];
+	struct timespec drawn;
+	size_t n, next;
+	double ms;
+	int wait, done;
+	bool busy, redraw = true;
 
 	if (!isatty(fileno(stdout))) {
 		return 1;
 	}
+	simd_init();
 	switch (argc) {
 	case 0: /* fallthrough */
 		*--argv = ".", ++argc;
@@ -725,20 +6293,88 @@ main(int argc, char *argv[])
 		printf("Failed to open stations list at %s\n", path);
 		return -1;
 	}
-	station_list_init(&sl, path);
-	if (player_init(&pl) < 0) {
+	if (station_list_init(&sl, path) < 0) {
+		return -1;
+	}
+	if (player_init(&pl, &sl) < 0) {
 		printf("Failed to initialize player\n");
 		return -1;
 	}
-	if (parse_stations(&sl, stream) < 0) {
-		printf("Failed to read stations\n");
+	if (fstat(fileno(stream), &sl.src) != 0) {
+		printf("Failed to read stations file\n");
 		return -1;
 	}
+	if (cache_load(&sl, stream) == 0) {
+		journal_open(&sl);
+	} else {
+		if (map_stations(&sl, stream) < 0) {
+			printf("Failed to read stations file\n");
+			return -1;
+		}
+		/* parse in the background while the ui comes up */
+		sl.loading = true;
+		if (pthread_create(&sl.loader, NULL, load_stations, &sl) != 0) {
+			load_stations(&sl);
+		}
+	}
 	fclose(stream);
 	tb_init();
+	clock_gettime(CLOCK_MONOTONIC, &drawn);
 
 	for (;;) {
-		station_list_render(&sl, &pl);
-		io_read(&sl, &pl);
+		list_lock(&sl);
+		if (sl.err[0]) {
+			tb_shutdown();
+			printf("%s\nFailed to read stations\n", sl.err);
+			return -1;
+		}
+		if (sl.compact_done) {
+			pthread_join(sl.compactor, NULL);
+			n = sl.snap->size;
+			ms = sl.snap->ms;
+			if (compact_finish(&sl) == 0) {
+				snprintf(pl.msg, sizeof(pl.msg),
+				    "Saved %zu stations in %.1f ms", n, ms);
+			} else {
+				strcpy_t(pl.msg, "Failed to save stations",
+				    sizeof(pl.msg));
+			}
+		} else if (!sl.snap && !sl.loading && sl.gen != sl.saved_gen
+		    && save_wait(&sl) <= 0) {
+			compact_start(&sl);
+		}
+		/*
+		 * build the search index, the block signatures and the
+		 * filtered view a slice at a time between events
+		 */
+		index_step(&sl, INDEX_STEP);
+		sig_step(&sl, INDEX_STEP / BLOCK_SZ);
+		next = sl.filt.next;
+		done = filter_step(&sl, FILTER_STEP);
+		if (sl.filt.next != next) {
+			redraw = true;
+		}
+		search_poll(&sl, &pl);
+		/*
+		 * draw only for a change, and progress on a clock; between
+		 * them sleep until woken, or until the next save is due
+		 */
+		busy = sl.loading || sl.srch.done != sl.srch.seq;
+		if (redraw || (busy && elapsed_ms(&drawn) >= DRAW_MS)) {
+			station_list_render(&sl, &pl);
+			clock_gettime(CLOCK_MONOTONIC, &drawn);
+		}
+		if ((!sl.tri_off && sl.tri_next < sl.nrec)
+		    || sl.sig_next < sl.nblocks || !done) {
+			wait = 0;
+		} else if (busy) {
+			wait = MAX(DRAW_MS - elapsed_ms(&drawn), 0);
+		} else if (!sl.snap && sl.gen != sl.saved_gen) {
+			wait = MAX(save_wait(&sl), DRAW_MS);
+		} else {
+			wait = -1;
+		}
+		pthread_mutex_unlock(&sl.lock);
+		redraw = io_read(&sl, &pl, wait);
 	}
 }
@@ -713,6 +713,7 @@ struct cellbuf_t {
     int width;
     int height;
     struct tb_cell *cells;
+    unsigned char *dirty; // per row, set when a cell of the row is written
 };
 
 struct cap_trie_t {
@@ -1605,6 +1606,11 @@ int tb_present(void) {
 
     int x, y, i;
     for (y = 0; y < global.front.height; y++) {
+        // Rows not written to since the last present are as on the terminal
+        if (!global.back.dirty[y]) {
+            continue;
+        }
+        global.back.dirty[y] = 0;
         for (x = 0; x < global.front.width;) {
             struct tb_cell *back, *front;
             if_err_return(rv, cellbuf_get(&global.back, x, y, &back));
@@ -1617,8 +1623,9 @@ int tb_present(void) {
                     w = wcswidth((wchar_t *)back->ech, back->nech);
                 else
 #endif
-                    /* wcwidth() simply returns -1 on overflow of wchar_t */
-                    w = wcwidth((wchar_t)back->ch);
+                    /* wcwidth() simply returns -1 on overflow of wchar_t,
+                     * and ASCII is never wide, so spare it the call */
+                    w = back->ch < 0x80 ? 1 : wcwidth((wchar_t)back->ch);
             }
             if (w < 1) {
                 w = 1;
@@ -1705,6 +1712,7 @@ int tb_set_cell_ex(int x, int y, uint32_t *ch, size_t nch, uintattr_t fg,
     struct tb_cell *cell;
     if_err_return(rv, cellbuf_get(&global.back, x, y, &cell));
     if_err_return(rv, cell_set(cell, ch, nch, fg, bg));
+    global.back.dirty[y] = 1;
     return TB_OK;
 }
 
@@ -1727,6 +1735,7 @@ int tb_extend_cell(int x, int y, uint32_t ch) {
     }
     cell->ech[nech] = '\0';
     cell->nech = nech;
+    global.back.dirty[y] = 1;
     return TB_OK;
 #else
     (void)x;
@@ -1884,6 +1893,8 @@ int tb_set_func(int fn_type, int (*fn)(struct tb_event *, size_t *)) {
 
 struct tb_cell *tb_cell_buffer(void) {
     if (!global.initialized) return NULL;
+    // Any cell may be written through the pointer
+    memset(global.back.dirty, 1, global.back.height);
     return global.back.cells;
 }
 
@@ -2945,6 +2956,7 @@ static int resize_cellbufs(void) {
     if_err_return(rv,
         cellbuf_resize(&global.front, global.width, global.height));
     if_err_return(rv, cellbuf_clear(&global.front));
+    memset(global.back.dirty, 1, global.back.height);
     if_err_return(rv, send_clear());
     return TB_OK;
 }
@@ -3275,6 +3287,13 @@ static int cellbuf_init(struct cellbuf_t *c, int w, int h) {
         return TB_ERR_MEM;
     }
     memset(c->cells, 0, sizeof(struct tb_cell) * w * h);
+    c->dirty = tb_malloc(h);
+    if (!c->dirty) {
+        tb_free(c->cells);
+        c->cells = NULL;
+        return TB_ERR_MEM;
+    }
+    memset(c->dirty, 1, h);
     c->width = w;
     c->height = h;
     return TB_OK;
@@ -3287,6 +3306,7 @@ static int cellbuf_free(struct cellbuf_t *c) {
             cell_free(&c->cells[i]);
         }
         tb_free(c->cells);
+        tb_free(c->dirty);
     }
     memset(c, 0, sizeof(*c));
     return TB_OK;
@@ -3299,6 +3319,7 @@ static int cellbuf_clear(struct cellbuf_t *c) {
         if_err_return(rv,
             cell_set(&c->cells[i], &space, 1, global.fg, global.bg));
     }
+    memset(c->dirty, 1, c->height);
     return TB_OK;
 }
 
@@ -3329,6 +3350,7 @@ static int cellbuf_resize(struct cellbuf_t *c, int w, int h) {
     int minh = (h < oh) ? h : oh;
 
     struct tb_cell *prev = c->cells;
+    unsigned char *prev_dirty = c->dirty;
 
     if_err_return(rv, cellbuf_init(c, w, h));
     if_err_return(rv, cellbuf_clear(c));
@@ -3344,6 +3366,7 @@ static int cellbuf_resize(struct cellbuf_t *c, int w, int h) {
     }
 
     tb_free(prev);
+    tb_free(prev_dirty);
 
     return TB_OK;
 }